@@ -0,0 +1,98 @@
+#include "burst_framer.hpp"
+
+#include <iostream>
+#include <string.h>
+
+using namespace std;
+using namespace suo;
+
+
+BurstFramer::BurstFramer(const GolayFramer::Config &conf) :
+	preamble_len(conf.preamble_len),
+	continuations(0),
+	in_burst(false)
+{
+	memset(&stats, 0, sizeof(stats));
+
+	if (conf.preamble_len < 2 || conf.syncword_len == 0 || conf.syncword_len > 32)
+		throw SuoError("BurstFramer: Invalid preamble or syncword length");
+
+	// Syncword is transmitted MSB first
+	for (int i = conf.syncword_len - 1; i >= 0; i--)
+		syncword.push_back((conf.syncword >> i) & 1);
+}
+
+
+void BurstFramer::continueBurst() {
+	continuations++;
+}
+
+
+long BurstFramer::findHeader(size_t from) const {
+	const size_t header_len = preamble_len + syncword.size();
+
+	for (size_t pos = from; pos + header_len <= pending.size(); pos++) {
+		const Symbol *p = &pending[pos];
+		if (equal(syncword.begin(), syncword.end(), p + preamble_len) == false)
+			continue;
+
+		// Preamble alternates, starting with either symbol
+		size_t i = 1;
+		while (i < preamble_len && p[i] != p[i - 1])
+			i++;
+		if (i == preamble_len)
+			return pos;
+	}
+	return -1;
+}
+
+
+void BurstFramer::generateSymbols(SymbolVector &symbols, Timestamp now) {
+
+	const size_t header_len = preamble_len + syncword.size();
+
+	while (1) {
+		framed.clear();
+		framed.flags = 0;
+		sourceSymbols.emit(framed, now);
+
+		if (framed.flags & SymbolVector::has_timestamp) {
+			symbols.timestamp = framed.timestamp;
+			symbols.flags |= SymbolVector::has_timestamp;
+		}
+		pending.insert(pending.end(), framed.begin(), framed.end());
+
+		// Remove the preambles of the continuing frames. The header beginning the burst is kept.
+		while (continuations > 0) {
+			const long pos = findHeader((in_burst || symbols.size() > 0) ? 0 : 1);
+			if (pos < 0)
+				break;
+			pending.erase(pending.begin() + pos, pending.begin() + pos + preamble_len);
+			continuations--;
+			stats.preambles_removed++;
+		}
+
+		if (framed.empty()) {
+			// The burst ends. A header which wasn't found will not arrive anymore.
+			if (continuations > 0) {
+				cerr << "BurstFramer: Header of " << continuations << " continuing frames not found, preamble transmitted" << endl;
+				stats.headers_missed += continuations;
+				continuations = 0;
+			}
+		}
+
+		// Hold back the symbols which can still be the beginning of a continuing frame's header
+		size_t ready = pending.size();
+		if (continuations > 0)
+			ready -= min(ready, header_len - 1);
+
+		symbols.insert(symbols.end(), pending.begin(), pending.begin() + ready);
+		pending.erase(pending.begin(), pending.begin() + ready);
+
+		// Don't return empty symbol vector in middle of the burst as it would end the transmission.
+		if (framed.empty() || symbols.empty() == false)
+			break;
+	}
+
+	in_burst = (symbols.empty() == false);
+}
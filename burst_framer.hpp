@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include <suo.hpp>
+#include <framing/golay_framer.hpp>
+
+
+/*
+ * Burst mode symbol filter between the framer and the modulator.
+ *
+ * Frames continuing an ongoing transmission are sent without the preamble, only the
+ * syncword separates them. The frame boundaries are found from the framer's output by
+ * the frame header (alternating preamble followed by the syncword), so the preamble is
+ * removed only where the continuing frame really begins, however the framer splits its
+ * output between the calls. Symbols which may be the beginning of a header are held
+ * back until the header is complete.
+ */
+class BurstFramer : public suo::Block
+{
+public:
+
+	struct Stats {
+		unsigned int preambles_removed;
+		unsigned int headers_missed;  // Continuing frames whose header wasn't found in the framer's output
+	};
+
+	/*
+	 * conf: Framer parameters giving the preamble length and the syncword
+	 */
+	explicit BurstFramer(const suo::GolayFramer::Config &conf);
+
+	BurstFramer(const BurstFramer &) = delete;
+	BurstFramer &operator=(const BurstFramer &) = delete;
+
+	/*
+	 * Generate symbols to be modulated (suo callback function).
+	 * An empty symbol vector is returned only when the framer has nothing more, which ends the burst.
+	 */
+	void generateSymbols(suo::SymbolVector &symbols, suo::Timestamp now);
+
+	/*
+	 * Remove the preamble of the frame which was sourced during the current
+	 * sourceSymbols call. Call from the sourceSymbols handler.
+	 */
+	void continueBurst();
+
+	const Stats &getStats() const { return stats; }
+
+	/* Source port for the framed symbols */
+	suo::Port<suo::SymbolVector &, suo::Timestamp> sourceSymbols;
+
+private:
+	/* Position of the first complete frame header in `pending` at or after `from`, or -1 */
+	long findHeader(size_t from) const;
+
+	unsigned int preamble_len;
+	std::vector<suo::Symbol> syncword;  // Syncword symbols in the transmission order
+
+	suo::SymbolVector framed;           // Output of the latest sourceSymbols call
+	std::vector<suo::Symbol> pending;   // Symbols not yet given to the modulator
+	unsigned int continuations;         // Continuing frames whose preamble hasn't been removed yet
+	bool in_burst;                      // Symbols of the ongoing burst have been given to the modulator
+
+	Stats stats;
+};
@@ -0,0 +1,268 @@
+#include "cached_gmsk_modulator.hpp"
+
+#include <cmath>
+#include <string.h>
+
+using namespace std;
+using namespace suo;
+
+
+/*
+ * Payload symbols affect the modulated waveform at most this many symbols before
+ * them (span of the Gaussian pulse). The header samples closer to the payload aren't cached.
+ */
+#define HEADER_MARGIN  4
+
+/* Output of the restarted modulator is used only after its ramp-up and this many symbols [symbols] */
+#define RESTART_WARMUP  8
+
+
+CachedGMSKModulator::CachedGMSKModulator(const GMSKModulator::Config &conf, const GolayFramer::Config &framer_conf) :
+	modulator(conf),
+	center_frequency(conf.center_frequency),
+	cache_len(0),
+	restart_symbol(0),
+	restart_skip(0),
+	overlap_len(0),
+	transmitting(false),
+	symbols_end(false),
+	burst_timed(false),
+	burst_time(0),
+	symbols_fed(0),
+	modulator_end(false),
+	chunk_offset(0),
+	skip(0),
+	correlation(0),
+	rotation(1),
+	rotating(false),
+	frequency_offset(0),
+	frequency(conf.center_frequency),
+	cache_frequency(0),
+	cache_valid(false),
+	recording(false),
+	replaying(false),
+	replay_index(0)
+{
+	memset(&stats, 0, sizeof(stats));
+
+	if (conf.sample_rate <= 0 || conf.symbol_rate <= 0)
+		throw SuoError("CachedGMSKModulator: Invalid sample or symbol rate");
+
+	modulator.generateSymbols.connect_member(this, &CachedGMSKModulator::sourceSymbols);
+
+	/*
+	 * The restarted modulator's samples line up with the cached ones only if it starts
+	 * at a symbol falling on a whole sample. With one symbol of overlap for the phase
+	 * measurement, the restart symbol must leave the warm-up before the end of the cache.
+	 */
+	const double samples_per_symbol = (double)conf.sample_rate / conf.symbol_rate;
+	header_len = framer_conf.preamble_len + framer_conf.syncword_len;
+	const int last_restart = (int)header_len - HEADER_MARGIN - RESTART_WARMUP - 1;
+	for (int s = last_restart; s > 0; s--) {
+		const double offset = s * samples_per_symbol;
+		if (fabs(offset - round(offset)) < 1e-6) {
+			restart_symbol = s;
+			break;
+		}
+	}
+	if (restart_symbol == 0)
+		return; // Header too short or no symbol on a whole sample: the burst header is not cached
+
+	cache_len = (size_t)floor((conf.ramp_up_duration + header_len - HEADER_MARGIN) * samples_per_symbol);
+	restart_skip = cache_len - (size_t)llround(restart_symbol * samples_per_symbol);
+	overlap_len = min(restart_skip, (size_t)ceil(samples_per_symbol));
+}
+
+
+void CachedGMSKModulator::setFrequencyOffset(float frequency) {
+	frequency_offset = frequency;
+}
+
+
+bool CachedGMSKModulator::fetchSymbols(Timestamp now) {
+	symbol_buffer.clear();
+	symbol_buffer.flags = 0;
+	generateSymbols.emit(symbol_buffer, now);
+	if (symbol_buffer.empty()) {
+		symbols_end = true;
+		return false;
+	}
+
+	// Timestamp in the first symbols of the burst gives the start time of the burst
+	if (transmitting == false && symbols.empty() && (symbol_buffer.flags & SymbolVector::has_timestamp)) {
+		burst_timed = true;
+		burst_time = symbol_buffer.timestamp;
+	}
+
+	symbols.insert(symbols.end(), symbol_buffer.begin(), symbol_buffer.end());
+	return true;
+}
+
+
+void CachedGMSKModulator::sourceSymbols(SymbolVector &out, Timestamp now) {
+
+	// suo's modulator starts a burst only when this modulator does
+	if (transmitting == false)
+		return;
+
+	if (symbols_fed == symbols.size()) {
+		symbols.clear();
+		symbols_fed = 0;
+		if (symbols_end || fetchSymbols(now) == false)
+			return; // suo's modulator ramps down and ends the burst
+	}
+
+	out.insert(out.end(), symbols.begin() + symbols_fed, symbols.end());
+	symbols_fed = symbols.size();
+}
+
+
+bool CachedGMSKModulator::startBurst(Timestamp now) {
+
+	symbols.clear();
+	symbols_fed = 0;
+	symbols_end = false;
+	burst_timed = false;
+
+	// Collect the complete header to see whether the cached waveform can be used
+	while (symbols.size() < header_len && fetchSymbols(now));
+	if (symbols.empty())
+		return false;
+
+	transmitting = true;
+	modulator_end = false;
+	chunk.clear();
+	chunk_offset = 0;
+	skip = 0;
+	rotating = false;
+	stats.bursts++;
+
+	replaying = false;
+	recording = false;
+	if (cache_len == 0 || symbols.size() < header_len)
+		return true;
+
+	if (cache_valid && cache_frequency == frequency &&
+	    equal(cache_header.begin(), cache_header.end(), symbols.begin())) {
+		// Replay the cache and restart suo's modulator near its end
+		replaying = true;
+		replay_index = 0;
+		symbols_fed = restart_symbol;
+		skip = restart_skip;
+		correlation = 0;
+		rotating = true;
+		stats.cache_hits++;
+	}
+	else {
+		// Record the header waveform while modulating this burst
+		cache_valid = false;
+		recording = true;
+		cache.clear();
+		cache.reserve(cache_len);
+		cache_header.assign(symbols.begin(), symbols.begin() + header_len);
+		cache_frequency = frequency;
+	}
+	return true;
+}
+
+
+void CachedGMSKModulator::modulateChunk(size_t len, Timestamp now) {
+	chunk.clear();
+	chunk.flags = 0;
+	chunk.timestamp = 0;
+	if (chunk.capacity() < len)
+		chunk.reserve(len);
+	chunk_offset = 0;
+
+	modulator.generateSamples(chunk, now);
+	if (chunk.empty() || (chunk.flags & SampleVector::end_of_burst))
+		modulator_end = true;
+}
+
+
+void CachedGMSKModulator::generateSamples(SampleVector &samples, Timestamp now) {
+
+	const float new_frequency = center_frequency + frequency_offset;
+	if (new_frequency != frequency) {
+		// Header waveform must be recorded again for the new frequency
+		frequency = new_frequency;
+		modulator.setFrequencyOffset(frequency - center_frequency);
+		cache_valid = false;
+		recording = false;
+	}
+
+	if (transmitting == false) {
+		if (startBurst(now) == false)
+			return;
+		samples.flags |= SampleVector::start_of_burst;
+		if (burst_timed) {
+			samples.flags |= SampleVector::has_timestamp;
+			samples.timestamp = burst_time;
+		}
+	}
+
+	while (samples.size() < samples.capacity()) {
+
+		if (replaying) {
+			/* Copy header samples from the cache */
+			const size_t n = min(cache_len - replay_index, samples.capacity() - samples.size());
+			samples.insert(samples.end(), cache.begin() + replay_index, cache.begin() + replay_index + n);
+			replay_index += n;
+			if (replay_index == cache_len)
+				replaying = false;
+			continue;
+		}
+
+		if (chunk_offset == chunk.size()) {
+			if (modulator_end) {
+				transmitting = false;
+				recording = false;
+				samples.flags |= SampleVector::end_of_burst;
+				break;
+			}
+			modulateChunk(samples.capacity() - samples.size(), now);
+			continue;
+		}
+
+		if (skip > 0) {
+			/*
+			 * Discard the restarted modulator's samples overlapping the cache. The last
+			 * ones differ from the cached samples only by a constant phase.
+			 */
+			const size_t n = min(skip, chunk.size() - chunk_offset);
+			for (size_t i = 0; i < n; i++, skip--) {
+				if (skip <= overlap_len)
+					correlation += complex<double>(cache[cache_len - skip]) * conj(complex<double>(chunk[chunk_offset + i]));
+			}
+			chunk_offset += n;
+			if (skip == 0)
+				rotation = (abs(correlation) > 0) ? Sample(correlation / abs(correlation)) : Sample(1);
+			continue;
+		}
+
+		const size_t n = min(chunk.size() - chunk_offset, samples.capacity() - samples.size());
+		for (size_t i = 0; i < n; i++) {
+			Sample sample = chunk[chunk_offset + i];
+			if (rotating)
+				sample *= rotation;
+			samples.push_back(sample);
+
+			if (recording) {
+				cache.push_back(sample);
+				if (cache.size() == cache_len) {
+					recording = false;
+					cache_valid = true;
+					stats.cache_recordings++;
+				}
+			}
+		}
+		chunk_offset += n;
+
+		if (chunk_offset == chunk.size() && modulator_end) {
+			transmitting = false;
+			recording = false;
+			samples.flags |= SampleVector::end_of_burst;
+			break;
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <complex>
+#include <vector>
+#include <stdint.h>
+
+#include <suo.hpp>
+#include <modem/mod_gmsk.hpp>
+#include <framing/golay_framer.hpp>
+
+/*
+ * GMSK burst modulator which caches the modulated waveform of the burst header.
+ *
+ * Every uplink burst begins with the same preamble and syncword. The modulation itself
+ * is done by suo's GMSKModulator. The samples of the burst header which don't depend on
+ * the payload are recorded from the first burst and replayed for the following bursts.
+ * For the rest of the burst, suo's modulator is restarted a few symbols before the end
+ * of the cached part, at a symbol falling on a whole sample, and its output is stitched
+ * to the cache: the samples overlapping the cache are discarded and the constant phase
+ * difference between the two runs is rotated away. The cache is re-recorded when the
+ * frequency changes.
+ */
+class CachedGMSKModulator : public suo::Block
+{
+public:
+
+	struct Stats {
+		unsigned int bursts;
+		unsigned int cache_hits;
+		unsigned int cache_recordings;
+	};
+
+	/*
+	 * conf: Modulator parameters (passed to suo's GMSKModulator)
+	 * framer_conf: Framer parameters used to determine the length of the constant burst header
+	 */
+	CachedGMSKModulator(const suo::GMSKModulator::Config &conf, const suo::GolayFramer::Config &framer_conf);
+
+	CachedGMSKModulator(const CachedGMSKModulator &) = delete;
+	CachedGMSKModulator &operator=(const CachedGMSKModulator &) = delete;
+
+	/*
+	 * Generate samples to be transmitted (suo callback function).
+	 * The first and the last sample vector of a burst are marked with
+	 * start_of_burst and end_of_burst flags. If the first symbols of the burst have
+	 * a timestamp, the first sample vector gets it as the burst start time.
+	 */
+	void generateSamples(suo::SampleVector &samples, suo::Timestamp now);
+
+	/* Set frequency offset from the center frequency. Can be called from any thread. */
+	void setFrequencyOffset(float frequency);
+
+	/* Number of header samples replayed from the cache. 0 if the header is too short to be cached. */
+	size_t getCacheLength() const { return cache_len; }
+
+	const Stats &getStats() const { return stats; }
+
+	/* Source port for the symbols to be modulated */
+	suo::Port<suo::SymbolVector &, suo::Timestamp> generateSymbols;
+
+private:
+	/* Start a new burst. Returns false if there is nothing to transmit. */
+	bool startBurst(suo::Timestamp now);
+
+	/* Request more symbols from the source. Returns false when the burst has ended. */
+	bool fetchSymbols(suo::Timestamp now);
+
+	/* Symbol source of suo's modulator */
+	void sourceSymbols(suo::SymbolVector &symbols, suo::Timestamp now);
+
+	/* Run suo's modulator for the next output chunk */
+	void modulateChunk(size_t len, suo::Timestamp now);
+
+	suo::GMSKModulator modulator;
+	float center_frequency;
+
+	unsigned int header_len;   // Length of the constant burst header [symbols]
+	size_t cache_len;          // Number of samples not affected by the symbols after the header
+	unsigned int restart_symbol;  // Header symbol from which suo's modulator is restarted on a cache hit
+	size_t restart_skip;       // Samples of the restarted modulator overlapping the cache
+	size_t overlap_len;        // Overlapping samples used to measure the phase difference
+
+	/* Burst state */
+	bool transmitting;
+	bool symbols_end;
+	bool burst_timed;
+	suo::Timestamp burst_time;
+	suo::SymbolVector symbols;  // Symbols of the burst collected for the header comparison
+	size_t symbols_fed;         // Symbols of `symbols` given to suo's modulator
+	suo::SymbolVector symbol_buffer;
+	bool modulator_end;         // suo's modulator has ended the burst
+
+	/* Output of suo's modulator */
+	suo::SampleVector chunk;
+	size_t chunk_offset;
+	size_t skip;                // Samples still to be discarded
+	std::complex<double> correlation;  // Restarted modulator against the cache over the overlap
+	suo::Sample rotation;       // Phase correction of the restarted modulator
+	bool rotating;
+
+	/* Carrier */
+	std::atomic<float> frequency_offset;
+	float frequency;
+
+	/* Header waveform cache */
+	std::vector<suo::Sample> cache;
+	std::vector<suo::Symbol> cache_header;
+	float cache_frequency;
+	bool cache_valid;
+	bool recording;
+	bool replaying;
+	size_t replay_index;
+
+	Stats stats;
+};
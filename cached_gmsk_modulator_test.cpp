@@ -0,0 +1,167 @@
+/*
+ * Parity of CachedGMSKModulator with suo's GMSKModulator.
+ *
+ * Random bursts beginning with the same preamble and syncword are modulated by both.
+ * Cached bursts must have the same length (give or take the last sample of the ramp-down)
+ * and the same samples as suo's modulator up to a constant carrier phase, which is
+ * arbitrary at the start of a burst. Some bursts have a different header or frequency
+ * offset so that the cache is also re-recorded.
+ *
+ * Build with -DBUILD_TESTS=ON and run ./cached_gmsk_modulator_test [bursts]
+ */
+#include "cached_gmsk_modulator.hpp"
+
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+using namespace suo;
+
+
+/* Maximum deviation from suo's samples after removing the constant phase */
+#define MAX_ERROR  1e-4
+
+
+/* Symbol source giving one burst in random sized pieces */
+struct BurstSource {
+	vector<Symbol> symbols;
+	size_t pos;
+	mt19937 *rng;
+
+	void generateSymbols(SymbolVector &out, Timestamp) {
+		const size_t n = min<size_t>(1 + (*rng)() % 300, symbols.size() - pos);
+		out.insert(out.end(), symbols.begin() + pos, symbols.begin() + pos + n);
+		pos += n;
+	}
+};
+
+
+/* Run a modulator until the end of the burst. Returns false if the burst flags are wrong. */
+template<typename Modulator>
+static bool modulate(Modulator &modulator, vector<Sample> &out, size_t buffer_len) {
+	out.clear();
+	SampleVector samples;
+	samples.reserve(buffer_len);
+	for (unsigned int i = 0; ; i++) {
+		samples.clear();
+		samples.flags = 0;
+		modulator.generateSamples(samples, 0);
+		out.insert(out.end(), samples.begin(), samples.end());
+
+		if (i == 0 && (samples.flags & SampleVector::start_of_burst) == 0)
+			return false;
+		if (samples.flags & SampleVector::end_of_burst)
+			return true;
+		if (samples.empty() || i > 100000)
+			return false;
+	}
+}
+
+
+static unsigned int compare(const char *name, float sample_rate, size_t count, mt19937 &rng) {
+
+	GMSKModulator::Config conf;
+	conf.sample_rate = sample_rate;
+	conf.symbol_rate = 9600;
+	conf.center_frequency = 25000;
+	conf.bt = 0.5;
+	conf.ramp_up_duration = 2;
+	conf.ramp_down_duration = 2;
+
+	GolayFramer::Config framer_conf;
+	framer_conf.syncword = 0x1ACFFC1D;
+	framer_conf.syncword_len = 32;
+	framer_conf.preamble_len = 24 * 8;
+
+	GMSKModulator reference(conf);
+	CachedGMSKModulator cached(conf, framer_conf);
+
+	BurstSource reference_source, cached_source;
+	reference_source.rng = cached_source.rng = &rng;
+	reference.generateSymbols.connect_member(&reference_source, &BurstSource::generateSymbols);
+	cached.generateSymbols.connect_member(&cached_source, &BurstSource::generateSymbols);
+
+	unsigned int mismatches = 0;
+	double max_error = 0;
+	for (size_t b = 0; b < count; b++) {
+
+		// Burst header, occasionally a different one
+		vector<Symbol> symbols;
+		const unsigned int phase = (rng() % 8 == 0) ? 1 : 0;
+		for (unsigned int i = 0; i < framer_conf.preamble_len; i++)
+			symbols.push_back((i + phase) & 1);
+		for (int i = framer_conf.syncword_len - 1; i >= 0; i--)
+			symbols.push_back((framer_conf.syncword >> i) & 1);
+
+		// Payload
+		const size_t payload_len = 8 + rng() % 2000;
+		for (size_t i = 0; i < payload_len; i++)
+			symbols.push_back(rng() & 1);
+
+		// Doppler correction changes now and then
+		if (rng() % 16 == 0) {
+			const float offset = (float)(rng() % 2000) - 1000;
+			reference.setFrequencyOffset(offset);
+			cached.setFrequencyOffset(offset);
+		}
+
+		reference_source.symbols = cached_source.symbols = symbols;
+		reference_source.pos = cached_source.pos = 0;
+
+		const size_t buffer_len = 100 + rng() % 2000;
+		vector<Sample> ref, out;
+		const bool ref_ok = modulate(reference, ref, buffer_len);
+		const bool ok = modulate(cached, out, buffer_len);
+
+		// The end of the ramp-down can fall on either side of a sample when the restarted
+		// modulator's symbol clock rounds differently. Such a sample has no amplitude.
+		const size_t len = min(ref.size(), out.size());
+		const vector<Sample> &longer = (ref.size() > out.size()) ? ref : out;
+		if (ref_ok == false || ok == false || longer.size() > len + 1 ||
+		    (longer.size() > len && abs(longer.back()) > MAX_ERROR)) {
+			printf("%s: Burst %zu: %zu samples, expected %zu\n", name, b, out.size(), ref.size());
+			mismatches++;
+			continue;
+		}
+
+		// Remove the constant phase difference
+		complex<double> correlation = 0;
+		for (size_t i = 0; i < len; i++)
+			correlation += complex<double>(out[i]) * conj(complex<double>(ref[i]));
+		const complex<double> rotation = correlation / abs(correlation);
+
+		double error = 0;
+		for (size_t i = 0; i < len; i++)
+			error = max(error, abs(complex<double>(out[i]) - rotation * complex<double>(ref[i])));
+		max_error = max(max_error, error);
+		if (error > MAX_ERROR) {
+			printf("%s: Burst %zu: Samples differ by %g\n", name, b, error);
+			mismatches++;
+		}
+	}
+
+	const CachedGMSKModulator::Stats &stats = cached.getStats();
+	printf("%-10s %6zu bursts: %6u cache hits, %4u recordings, %zu cached samples, max error %.2g, %u mismatches\n",
+	       name, count, stats.cache_hits, stats.cache_recordings, cached.getCacheLength(), max_error, mismatches);
+
+	if (cached.getCacheLength() == 0 || stats.cache_hits == 0) {
+		printf("%s: The header was not cached\n", name);
+		mismatches++;
+	}
+	return mismatches;
+}
+
+
+int main(int argc, char *argv[]) {
+
+	const size_t count = (argc > 1) ? atoi(argv[1]) : 200;
+	mt19937 rng(1);
+
+	unsigned int mismatches = 0;
+	mismatches += compare("1 MHz", 1e6, count, rng);     // 625 samples every 6 symbols
+	mismatches += compare("48 kHz", 48e3, count, rng);   // 5 samples per symbol
+
+	return (mismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+#include "codeword_combiner.hpp"
+#include "symbol_reliability.hpp"
+#include "tx_scheduler.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+
+CodewordCombiner::CodewordCombiner(unsigned int _slots, unsigned int _window, float _max_ber, unsigned int _max_erasures) :
+	slots(_slots),
+	window(_window),
+	max_ber(_max_ber),
+	max_erasures(_max_erasures)
+{
+	for (Slot &slot: slots)
+		slot.time = 0;
+}
+
+
+void CodewordCombiner::store(const uint8_t *codeword, size_t len, const uint8_t *weight, uint64_t now) {
+	if (slots.empty())
+		return;
+
+	Slot *oldest = &slots[0];
+	for (Slot &slot: slots) {
+		if (slot.time < oldest->time)
+			oldest = &slot;
+	}
+
+	oldest->time = now;
+	oldest->len = len;
+	memcpy(oldest->codeword, codeword, len);
+	memcpy(oldest->weight, weight, len);
+}
+
+
+int CodewordCombiner::recover(uint8_t *codeword, size_t len, const uint8_t *reliability, const Decoder &decode, unsigned int &copies) {
+
+	copies = 0;
+	if (len == 0 || len > COMBINER_CODEWORD_MAX || slots.empty())
+		return -1;
+
+	// Vote weight of the bytes. Without soft information every byte is equal.
+	uint8_t weight[COMBINER_CODEWORD_MAX];
+	for (size_t i = 0; i < len; i++)
+		weight[i] = (reliability != NULL) ? (1 + reliability[i]) : 64;
+
+	lock_guard<mutex> guard(lock);
+	const uint64_t now = tx_clock_ms();
+
+	/* Find the earlier copies: Same length and only a few bits differing. Different frames differ in half of the bits. */
+	const unsigned int max_distance = max_ber * len * 8;
+	vector<Slot*> matches;
+	for (Slot &slot: slots) {
+		if (slot.time == 0)
+			continue;
+		if (slot.time + window < now) {
+			slot.time = 0;
+			continue;
+		}
+		if (slot.len != len)
+			continue;
+
+		unsigned int distance = 0;
+		for (size_t i = 0; i < len && distance <= max_distance; i++)
+			distance += __builtin_popcount(slot.codeword[i] ^ codeword[i]);
+		if (distance <= max_distance)
+			matches.push_back(&slot);
+	}
+
+	if (matches.empty()) {
+		store(codeword, len, weight, now);
+		return -1;
+	}
+
+	/* Weighted bitwise vote. The reliability of a byte is the margin of its closest bit vote. */
+	uint8_t combined[COMBINER_CODEWORD_MAX], byte_reliability[COMBINER_CODEWORD_MAX];
+	for (size_t i = 0; i < len; i++) {
+		int total = weight[i];
+		for (const Slot *slot: matches)
+			total += slot->weight[i];
+
+		uint8_t byte = 0;
+		int margin = total;
+		for (unsigned int bit = 0; bit < 8; bit++) {
+			const uint8_t mask = 1 << bit;
+			int vote = (codeword[i] & mask) ? weight[i] : -weight[i];
+			for (const Slot *slot: matches)
+				vote += (slot->codeword[i] & mask) ? slot->weight[i] : -slot->weight[i];
+
+			// Tie goes to the latest copy
+			if (vote > 0 || (vote == 0 && (codeword[i] & mask)))
+				byte |= mask;
+			margin = min(margin, abs(vote));
+		}
+		combined[i] = byte;
+		byte_reliability[i] = margin * 127 / total;
+	}
+
+	/* Decode marking the bytes without a clear majority as erasures */
+	uint8_t attempt[COMBINER_CODEWORD_MAX];
+	memcpy(attempt, combined, len);
+	int eras_pos[COMBINER_CODEWORD_MAX];
+	const int no_eras = select_erasures(byte_reliability, len, max_erasures, 127, eras_pos);
+	int ret = decode(attempt, eras_pos, no_eras);
+
+	if (ret < 0 && no_eras > 0 && matches.size() >= 2) {
+		// With three or more copies the plain majority may be right where the erasures exceed the capacity
+		memcpy(attempt, combined, len);
+		ret = decode(attempt, NULL, 0);
+	}
+
+	if (ret < 0) {
+		store(codeword, len, weight, now);
+		return ret;
+	}
+
+	memcpy(codeword, attempt, len);
+	copies = matches.size() + 1;
+	for (Slot *slot: matches)
+		slot->time = 0;
+	return ret;
+}
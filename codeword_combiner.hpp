@@ -0,0 +1,64 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+/* Longest codeword [bytes] */
+#define COMBINER_CODEWORD_MAX  255
+
+
+/*
+ * Recovers repeated frames (e.g. beacons and retransmissions) which fail
+ * Reed-Solomon decoding by combining the corrupted copies.
+ *
+ * Codewords which couldn't be decoded are kept for a while. A new failed codeword
+ * of the same length with only a few bits differing from a kept one is taken as a
+ * copy of the same frame. The copies are combined by a bitwise vote weighted by the
+ * byte reliabilities (if known) and the bytes the copies disagree on are passed to
+ * the decoder as erasures. Thread safe.
+ */
+class CodewordCombiner
+{
+public:
+	/*
+	 * Decoder for the combined codeword: (codeword, erasure positions, number of erasures).
+	 * Returns the number of corrected symbols or negative on failure.
+	 */
+	typedef std::function<int(uint8_t *codeword, int *eras_pos, int no_eras)> Decoder;
+
+	/*
+	 * slots: Maximum number of failed codewords kept
+	 * window: Time a failed codeword is kept [ms]
+	 * max_ber: Maximum fraction of differing bits between copies of the same frame
+	 * max_erasures: Maximum number of erasures given to the decoder
+	 */
+	CodewordCombiner(unsigned int slots, unsigned int window, float max_ber, unsigned int max_erasures);
+
+	/*
+	 * Try to recover a codeword which failed decoding. On success the codeword is replaced
+	 * with the decoded one and the copies used are forgotten. Otherwise the codeword is kept
+	 * for the next copies. `reliability` can be NULL.
+	 * Returns the decoder's result or -1 if there were no copies. `copies` is set to the number of
+	 * codewords combined.
+	 */
+	int recover(uint8_t *codeword, size_t len, const uint8_t *reliability, const Decoder &decode, unsigned int &copies);
+
+private:
+	struct Slot {
+		uint64_t time;         // [ms]. 0 = free
+		size_t len;
+		uint8_t codeword[COMBINER_CODEWORD_MAX];
+		uint8_t weight[COMBINER_CODEWORD_MAX];   // Vote weight of each byte
+	};
+
+	/* Keep a codeword in the oldest slot */
+	void store(const uint8_t *codeword, size_t len, const uint8_t *weight, uint64_t now);
+
+	std::mutex lock;
+	std::vector<Slot> slots;
+	unsigned int window;
+	float max_ber;
+	unsigned int max_erasures;
+};
@@ -1,6 +1,8 @@
 
 #include "csp_gnuradio_adapter.hpp"
+#include "reed_solomon.hpp"
 
+#include <type_traits>
 #include <zmq.hpp>
 
 #include <pmt/pmt.h>
@@ -15,11 +17,12 @@
 
 #ifdef LIBFEC
 #include "libfec/fec.h"
+
+static_assert(std::is_same_v<CSPReedSolomon, CCSDSReedSolomon>, "libfec implements only the CCSDS code");
 #endif
 
-#define CSP_RS_LEN      32
-#define CSP_RS_MSGLEN   256
 #define CSP_SUO_MTU     256
+#define RX_BATCH_MAX    32
 
 
 using namespace std;
@@ -38,6 +41,7 @@ CSPGNURadioCAdapter::Config::Config()
 	use_xtea = false;
 	xtea_key[20] = {0};
 	filter_ground_addresses = true;
+	rx_batch = 8;
 }
 
 
@@ -48,6 +52,9 @@ CSPGNURadioCAdapter::CSPGNURadioCAdapter(const Config& _conf) :
 	memset(&csp_iface, 0, sizeof(csp_iface));
 	memset(&stats, 0, sizeof(stats));
 
+	if (conf.rx_batch == 0 || conf.rx_batch > RX_BATCH_MAX)
+		throw runtime_error("CSPGNURadioCAdapter: Invalid rx_batch");
+
 	if (conf.use_xtea)
 		csp_xtea_set_key(conf.xtea_key, 20);
 	if (conf.use_hmac)
@@ -144,7 +151,7 @@ int CSPGNURadioCAdapter::transmit(csp_packet_t *packet) {
 	if (conf.use_rs) {
 #ifdef LIBFEC
 		encode_rs_8((uint8_t*)&packet->id, &packet->data[packet->length], CSP_RS_MSGLEN - packet->length);
-		packet->length += CSP_RS_LEN;
+		packet->length += CSP_RS_PARITYS;
 #else
 		csp_log_error("libfec not supported\n");
 		return CSP_ERR_NOTSUP;
@@ -171,13 +178,83 @@ int CSPGNURadioCAdapter::transmit(csp_packet_t *packet) {
 
 
 void CSPGNURadioCAdapter::receive()
+{
+	/* Wait for a frame and take the other frames already waiting in the socket */
+	csp_packet_t *packets[RX_BATCH_MAX];
+	unsigned int count = 0;
+	packets[count] = receiveFrame(true);
+	if (packets[count] != NULL)
+		count++;
+	while (count < conf.rx_batch) {
+		packets[count] = receiveFrame(false);
+		if (packets[count] == NULL)
+			break;
+		count++;
+	}
+
+	/* Unrandomize data if necessary */
+	if (conf.use_rand) {
+		for (unsigned int i = 0; i < count; i++)
+			csp_apply_rand(packets[i]);
+	}
+
+	/* Decode Reed-Solomon error correction code. The codewords are decoded as a batch. */
+	if (conf.use_rs)
+	{
+#ifdef LIBFEC
+		uint8_t *codewords[RX_BATCH_MAX];
+		int pads[RX_BATCH_MAX], corrected[RX_BATCH_MAX];
+		for (unsigned int i = 0; i < count; i++) {
+			codewords[i] = (uint8_t *)&packets[i]->id;
+			pads[i] = CSP_RS_MSGLEN + CSP_RS_PARITYS - packets[i]->length;
+		}
+		decode_rs_8_batch(codewords, pads, NULL, corrected, count);
+
+		for (unsigned int i = 0; i < count; i++) {
+			if (corrected[i] < 0)
+			{
+				csp_log_error("Failed to decode RS");
+				csp_buffer_free(packets[i]);
+				packets[i] = NULL;
+				stats.rx_failed++;
+				continue;
+			}
+			csp_log_info("RS corrected %d errors", corrected[i]);
+			stats.rx_corrected_bytes += corrected[i];
+		}
+
+#if 0
+		/* Count bit errors */
+		unsigned int corrected_bits = 0;
+		const uint8_t* original = static_cast<uint8_t*>(&packet->id); // TODO
+		const uint8_t* corrected = static_cast<uint8_t *>(&packet->id);
+		for (unsigned int i = 0; i < packet->length; i++)
+			corrected_bits += popcount(original[i] ^ corrected[i]);
+		stats.rx_bits_corrected += corrected_bits;
+#endif
+#else
+		csp_log_error("libfec not supported\n");
+		for (unsigned int i = 0; i < count; i++)
+			csp_buffer_free(packets[i]);
+		return;
+#endif
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (packets[i] != NULL)
+			deliverFrame(packets[i]);
+	}
+}
+
+
+csp_packet_t *CSPGNURadioCAdapter::receiveFrame(bool wait)
 {
 	/* Receive raw frame from ZMQ socket */
 	zmq::message_t zmq_msg;
 	try {
-		auto res = sock_sub.recv(zmq_msg); // zmq::recv_flags::dontwait
-		if (res.value() == 0)
-			return;
+		auto res = sock_sub.recv(zmq_msg, wait ? zmq::recv_flags::none : zmq::recv_flags::dontwait);
+		if (res.has_value() == false || res.value() == 0)
+			return NULL;
 	}
 	catch (const zmq::error_t &e)
 	{
@@ -201,12 +278,12 @@ void CSPGNURadioCAdapter::receive()
 
 	if (raw_data_len < sizeof(csp_id_t)) {
 		csp_log_warn("Too short frame: %lu\n", raw_data_len);
-		return;
+		return NULL;
 	}
 
 	if (raw_data_len > CSP_SUO_MTU)  {
 		csp_log_warn("Too long frame: %lu\n", raw_data_len);
-		return;
+		return NULL;
 	}
 
 	/* Allocate CSP packet and store the bytes inside it. */
@@ -215,43 +292,14 @@ void CSPGNURadioCAdapter::receive()
 		throw runtime_error("csp_buffer_get failed!");
 	memcpy(&packet->id, raw_data, raw_data_len);
 	packet->length = raw_data_len;
+	return packet;
+}
 
-	/* Unrandomize data if necessary */
-	if (conf.use_rand)
-		csp_apply_rand(packet);
-
-	/* Append Reed-Solomon error correction code */
-	if (conf.use_rs)
-	{
-#ifdef LIBFEC
-		int ret = decode_rs_8((uint8_t *)&packet->id, NULL, 0, CSP_RS_MSGLEN + CSP_RS_LEN - packet->length);
-		if (ret < 0)
-		{
-			csp_log_error("Failed to decode RS");
-			csp_buffer_free(packet);
-			stats.rx_failed++;
-			return;
-		}
-		csp_log_info("RS corrected %d errors", ret);
-		stats.rx_corrected_bytes += ret;
-
-#if 0
-		/* Count bit errors */
-		unsigned int corrected_bits = 0;
-		const uint8_t* original = static_cast<uint8_t*>(&packet->id); // TODO
-		const uint8_t* corrected = static_cast<uint8_t *>(&packet->id);
-		for (unsigned int i = 0; i < packet->length; i++)
-			corrected_bits += popcount(original[i] ^ corrected[i]);
-		stats.rx_bits_corrected += corrected_bits;
-#endif
-#else
-		csp_log_error("libfec not supported\n");
-		return;
-#endif
-	}
 
+void CSPGNURadioCAdapter::deliverFrame(csp_packet_t *packet)
+{
 	/* The CSP packet length is without the header */
-	packet->length = raw_data_len - sizeof(csp_id_t);
+	packet->length -= sizeof(csp_id_t);
 
 	/* Convert the packet from network to host order */
 	packet->id.ext = csp_ntoh32(packet->id.ext);
@@ -259,6 +307,7 @@ void CSPGNURadioCAdapter::receive()
 	/* Ignore frame if source port indicates that is coming from ground segment. */
 	if (conf.filter_ground_addresses && packet->id.sport > 8) {
 		csp_log_info("Frame filtered");
+		csp_buffer_free(packet);
 		return;
 	}
 
@@ -28,6 +28,9 @@ public:
 		bool use_xtea;
 		uint8_t xtea_key[20];
         bool filter_ground_addresses;
+
+		/* Maximum number of waiting frames received at a time. Their RS codewords are decoded as a batch. */
+		unsigned int rx_batch;
     };
 
 	struct Stats
@@ -61,6 +64,12 @@ private:
 	Config conf;
 	Stats stats;
 
+	/* Read a frame from the ZMQ socket to a new CSP buffer. NULL if nothing was received or the frame is invalid. */
+	csp_packet_t *receiveFrame(bool wait);
+
+	/* Verify a decoded frame and pass it to CSP */
+	void deliverFrame(csp_packet_t *packet);
+
 	zmq::socket_t sock_pub, sock_sub;
 	csp_bin_sem_handle_t tx_wait;
 
@@ -38,7 +38,11 @@ typedef struct
 	void *context;
 	void *publisher;
 	void *subscriber;
+	void *events;
 	csp_bin_sem_handle_t tx_wait;
+	csp_bin_sem_handle_t event_wait;
+	csp_zmqserver_schedule_cb_t schedule_cb;
+	void *schedule_arg;
 	char name[CSP_IFLIST_NAME_MAX + 1];
 	csp_iface_t iface;
 } zmq_driver_t;
@@ -72,6 +76,23 @@ int csp_zmqserver_tx(const csp_route_t *route, csp_packet_t *packet)
 	return CSP_ERR_NONE;
 }
 
+/**
+ * Receive and discard the remaining parts of a multipart message
+ */
+static void csp_zmqserver_discard_parts(void *socket, bool more)
+{
+	while (more)
+	{
+		zmq_msg_t msg;
+		zmq_msg_init(&msg);
+		if (zmq_msg_recv(&msg, socket, 0) < 0)
+			more = false;
+		else
+			more = zmq_msg_more(&msg);
+		zmq_msg_close(&msg);
+	}
+}
+
 CSP_DEFINE_TASK(csp_zmqserver_task)
 {
 
@@ -93,11 +114,13 @@ CSP_DEFINE_TASK(csp_zmqserver_task)
 			continue;
 		}
 
+		const bool more = zmq_msg_more(&msg);
 		unsigned int datalen = zmq_msg_size(&msg);
 		if (datalen < HEADER_SIZE)
 		{
 			csp_log_warn("RX %s: Too short datalen: %u - expected min %u bytes", drv->iface.name, datalen, HEADER_SIZE);
 			zmq_msg_close(&msg);
+			csp_zmqserver_discard_parts(drv->subscriber, more);
 			continue;
 		}
 
@@ -108,6 +131,7 @@ CSP_DEFINE_TASK(csp_zmqserver_task)
 		{
 			csp_log_warn("RX %s: Failed to get csp_buffer(%u)", drv->iface.name, datalen);
 			zmq_msg_close(&msg);
+			csp_zmqserver_discard_parts(drv->subscriber, more);
 			continue;
 		}
 
@@ -122,10 +146,40 @@ CSP_DEFINE_TASK(csp_zmqserver_task)
 		memcpy(&packet->id, rx_data, datalen);
 		packet->length = (datalen - sizeof(packet->id));
 
-		// Route packet
-		csp_qfifo_write(packet, &drv->iface, NULL);
-
 		zmq_msg_close(&msg);
+
+		// Optional second part: Transmission schedule
+		bool taken = false;
+		if (more)
+		{
+			zmq_msg_init(&msg);
+			if (zmq_msg_recv(&msg, drv->subscriber, 0) < 0)
+			{
+				csp_log_error("RX %s: %s", drv->iface.name, zmq_strerror(zmq_errno()));
+				zmq_msg_close(&msg);
+				csp_buffer_free(packet);
+				continue;
+			}
+
+			if (zmq_msg_size(&msg) == sizeof(csp_zmqserver_schedule_t) && drv->schedule_cb != NULL)
+			{
+				csp_zmqserver_schedule_t schedule;
+				memcpy(&schedule, zmq_msg_data(&msg), sizeof(schedule));
+				taken = drv->schedule_cb(packet, &schedule, drv->schedule_arg);
+			}
+			else
+			{
+				csp_log_warn("RX %s: Ignoring schedule part of %u bytes", drv->iface.name, (unsigned int)zmq_msg_size(&msg));
+			}
+
+			const bool further = zmq_msg_more(&msg);
+			zmq_msg_close(&msg);
+			csp_zmqserver_discard_parts(drv->subscriber, further);
+		}
+
+		// Route packet
+		if (taken == false)
+			csp_qfifo_write(packet, &drv->iface, NULL);
 	}
 
 	return CSP_TASK_RETURN;
@@ -253,3 +307,73 @@ int csp_zmqserver_init_w_name_endpoints_rxfilter(const char *ifname,
 
 	return CSP_ERR_NONE;
 }
+
+
+int csp_zmqserver_set_schedule_callback(csp_iface_t *iface, csp_zmqserver_schedule_cb_t callback, void *arg)
+{
+	zmq_driver_t *drv = static_cast<zmq_driver_t*>(iface->driver_data);
+	drv->schedule_arg = arg;
+	drv->schedule_cb = callback;
+	return CSP_ERR_NONE;
+}
+
+
+int csp_zmqserver_init_events(csp_iface_t *iface, const char *event_endpoint)
+{
+	zmq_driver_t *drv = static_cast<zmq_driver_t*>(iface->driver_data);
+
+	csp_log_info("INIT %s: events: [%s]", drv->iface.name, event_endpoint);
+
+	drv->events = zmq_socket(drv->context, ZMQ_PUB);
+	assert(drv->events);
+	assert(zmq_bind(drv->events, event_endpoint) == 0);
+
+	/* Events can be published from multiple threads */
+	assert(csp_bin_sem_create(&drv->event_wait) == CSP_SEMAPHORE_OK);
+
+	return CSP_ERR_NONE;
+}
+
+int csp_zmqserver_publish_event(csp_iface_t *iface, const void *data, size_t len)
+{
+	zmq_driver_t *drv = static_cast<zmq_driver_t*>(iface->driver_data);
+	if (drv->events == NULL)
+		return CSP_ERR_INVAL;
+
+	csp_bin_sem_wait(&drv->event_wait, 1000);
+	int result = zmq_send(drv->events, data, len, ZMQ_DONTWAIT);
+	csp_bin_sem_post(&drv->event_wait);
+	if (result < 0)
+	{
+		csp_log_error("ZMQ event send error: %u %s\r\n", result, zmq_strerror(zmq_errno()));
+		return CSP_ERR_TX;
+	}
+
+	return CSP_ERR_NONE;
+}
+
+int csp_zmqserver_publish_packet(csp_iface_t *iface, csp_id_t id, const uint8_t *data, size_t len)
+{
+	zmq_driver_t *drv = static_cast<zmq_driver_t*>(iface->driver_data);
+
+	// Same format as csp_zmqserver_tx: Destination, CSP header and payload
+	zmq_msg_t msg;
+	if (zmq_msg_init_size(&msg, sizeof(uint8_t) + sizeof(id) + len) != 0)
+		return CSP_ERR_NOMEM;
+	uint8_t *buf = static_cast<uint8_t*>(zmq_msg_data(&msg));
+	buf[0] = id.dst;
+	memcpy(&buf[1], &id, sizeof(id));
+	memcpy(&buf[1 + sizeof(id)], data, len);
+
+	csp_bin_sem_wait(&drv->tx_wait, 1000);
+	int result = zmq_msg_send(&msg, drv->publisher, 0);
+	csp_bin_sem_post(&drv->tx_wait);
+	if (result < 0)
+	{
+		csp_log_error("ZMQ send error: %u %s\r\n", result, zmq_strerror(zmq_errno()));
+		zmq_msg_close(&msg);
+		return CSP_ERR_TX;
+	}
+
+	return CSP_ERR_NONE;
+}
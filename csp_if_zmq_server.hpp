@@ -6,6 +6,8 @@
 
 #define CSP_ZMQSERVER_PUBLISH_PORT 7000
 
+#define CSP_ZMQSERVER_EVENT_PORT 7001
+
 
 /**
    Default ZMQ interface name.
@@ -26,4 +28,43 @@ int csp_zmqserver_init_w_name_endpoints_rxfilter(const char *ifname,
                                                  const char *publish_endpoint,
                                                  const char *subscribe_endpoint,
                                                  uint32_t flags,
-                                                 csp_iface_t **return_interface);
\ No newline at end of file
+                                                 csp_iface_t **return_interface);
+
+/**
+   Transmission schedule for a packet.
+   A client can send it as an optional second part of a multipart message after the packet.
+   Multi-byte fields are little endian.
+*/
+#define CSP_ZMQSERVER_SCHEDULE_TIME 1 // value is SDR time [ns]
+#define CSP_ZMQSERVER_SCHEDULE_SLOT 2 // value is TDMA time slot number
+
+typedef struct __attribute__((packed))
+{
+	uint8_t type;
+	uint64_t value;
+} csp_zmqserver_schedule_t;
+
+/**
+   Called from the RX thread for a scheduled packet before it is routed.
+   Returns true if the callback took the packet, e.g. queued it directly to the transmitting
+   interface. Otherwise the packet is routed as usual.
+*/
+typedef bool (*csp_zmqserver_schedule_cb_t)(csp_packet_t *packet, const csp_zmqserver_schedule_t *schedule, void *arg);
+
+int csp_zmqserver_set_schedule_callback(csp_iface_t *iface, csp_zmqserver_schedule_cb_t callback, void *arg);
+
+/**
+   Open an additional publisher socket for modem events (e.g. TX completion notifications).
+*/
+int csp_zmqserver_init_events(csp_iface_t *iface, const char *event_endpoint);
+
+/**
+   Publish a single event message on the event socket. Can be called from any thread.
+*/
+int csp_zmqserver_publish_event(csp_iface_t *iface, const void *data, size_t len);
+
+/**
+   Publish a packet which is not in a CSP buffer, e.g. larger than the CSP buffers.
+   The message format is the same as for the routed packets. Can be called from any thread.
+*/
+int csp_zmqserver_publish_packet(csp_iface_t *iface, csp_id_t id, const uint8_t *data, size_t len);
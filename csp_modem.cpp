@@ -2,6 +2,9 @@
 
 #include <string>
 #include <iostream>
+#include <mutex>
+#include <atomic>
+#include <endian.h>
 
 /* Suo stuff */
 #include <suo.hpp>
@@ -16,20 +19,26 @@
 #ifdef USE_PORTHOUSE_TRACKER
 #include <misc/porthouse_tracker.hpp>
 #endif
-#ifdef USE_RIGCTL
+#ifdef USE_RIGCTL_TRACKER
 #include <misc/rigctl.hpp>
 #endif
 
 #include "csp_suo_adapter.hpp"
+#include "cached_gmsk_modulator.hpp"
+#include "burst_framer.hpp"
+#include "squelch.hpp"
 
 /* CSP stuff */
 #include <csp/csp.h>
 #include <csp/arch/csp_thread.h>
+#include <csp/csp_rtable.h>
 #include "csp_if_zmq_server.hpp"
 
 using namespace std;
 using namespace suo;
 
+/* Uplink is considered down if the tracker hasn't updated the uplink frequency for this long [ms] */
+#define LINK_TIMEOUT  5000
 
 
 CSP_DEFINE_TASK(service_task)
@@ -69,24 +78,40 @@ int main(int argc, char *argv[])
 
 		// Setup receiver
 		GMSKContinousDemodulator demodulator(cfg_gmsk_demodulator());
-		sdr.sinkSamples.connect_member(&demodulator, &GMSKContinousDemodulator::sinkSamples);
+
+		// Demodulate only when there is energy on the channel
+		Squelch squelch(cfg_squelch());
+		sdr.sinkSamples.connect_member(&squelch, &Squelch::sinkSamples);
+		squelch.sinkPassedSamples.connect_member(&demodulator, &GMSKContinousDemodulator::sinkSamples);
 
 		// Setup frame decoder
 		GolayDeframer deframer(cfg_golay_deframer());
-		deframer.syncDetected.connect_member(&demodulator, &GMSKContinousDemodulator::lockReceiver);
+		deframer.syncDetected.connect([&](bool locked, Timestamp now) {
+			demodulator.lockReceiver(locked, now);
+			squelch.lockReceiver(locked, now);
+		});
 		//deframer.syncDetected.connect([](bool locked, Timestamp now) {
 		//	cout << "locked " << locked << endl;
 		//});
-		demodulator.sinkSymbol.connect_member(&deframer, &GolayDeframer::sinkSymbol);
+		// Reliability of the received bytes for the adapter's erasure decoding
+		SymbolReliability symbol_reliability;
+		demodulator.sinkSymbol.connect([&](Symbol symbol, Timestamp now) {
+			symbol_reliability.sinkSymbol(symbol, now);
+			deframer.sinkSymbol(symbol, now);
+		});
 		demodulator.setMetadata.connect_member(&deframer, &GolayDeframer::setMetadata);
 
-		// Setup transmitter
-		GMSKModulator modulator(cfg_gmsk_modulator());
-		sdr.generateSamples.connect_member(&modulator, &GMSKModulator::generateSamples);
-
 		// Setup framer
-		GolayFramer framer(cfg_golay_framer());
-		modulator.generateSymbols.connect_member(&framer, &GolayFramer::generateSymbols);
+		const GolayFramer::Config framer_conf = cfg_golay_framer();
+		GolayFramer framer(framer_conf);
+
+		// Setup transmitter. The waveform of the constant burst header is cached.
+		CachedGMSKModulator modulator(cfg_gmsk_modulator(), framer_conf);
+
+		// Framing and modulation run ahead of the SDR in the TX sample buffer's thread
+		TxSampleBuffer tx_buffer(cfg_tx_sample_buffer());
+		tx_buffer.sourceSamples.connect_member(&modulator, &CachedGMSKModulator::generateSamples);
+		sdr.generateSamples.connect_member(&tx_buffer, &TxSampleBuffer::generateSamples);
 
 
 		/*
@@ -128,10 +153,36 @@ int main(int argc, char *argv[])
 
 		//Setup CSP proxy
 		CSPSuoAdapter csp_adapter(cfg_csp_suo_adapter());
-#ifdef OUTPUT_RAW_FRAMES
+#ifndef OUTPUT_RAW_FRAMES
 		framer.sourceFrame.connect_member(&csp_adapter, &CSPSuoAdapter::sourceFrame);
 #endif
-		deframer.sinkFrame.connect_member(&csp_adapter, &CSPSuoAdapter::sinkFrame);
+		deframer.sinkFrame.connect([&](const Frame& frame, Timestamp now) {
+			uint8_t reliability[CSP_RS_MSGLEN + CSP_RS_PARITYS];
+			const bool known = frame.size() <= sizeof(reliability) &&
+			                   symbol_reliability.getByteReliability(frame.size(), reliability);
+			csp_adapter.sinkFrameWithReliability(frame, known ? reliability : NULL, now);
+		});
+
+		/*
+		 * Connect framer to modulator. In burst mode the frames continuing an ongoing
+		 * transmission are sent without the preamble, only the syncword separates them.
+		 * The burst framer removes the preamble of the frame the adapter marks as a continuation.
+		 */
+		BurstFramer burst_framer(framer_conf);
+		modulator.generateSymbols.connect_member(&burst_framer, &BurstFramer::generateSymbols);
+		burst_framer.sourceSymbols.connect([&](SymbolVector& symbols, Timestamp now) {
+			framer.generateSymbols(symbols, now);
+
+			// Scheduled frame: Modulator starts the burst at the given SDR time
+			Timestamp tx_time;
+			if (csp_adapter.takeScheduledTime(tx_time)) {
+				symbols.timestamp = tx_time;
+				symbols.flags |= SymbolVector::has_timestamp;
+			}
+
+			if (csp_adapter.takeBurstContinuation())
+				burst_framer.continueBurst();
+		});
 
 #ifdef CSP_RTABLE_CIDR
 		// Route packets going to addresses 0-7 to space 
@@ -148,14 +199,32 @@ int main(int argc, char *argv[])
 		csp_thread_create(service_task, "Service", 1000, NULL, 0, NULL);
 
 
+#if defined(USE_PORTHOUSE_TRACKER) || defined(USE_RIGCTL_TRACKER)
+		/*
+		 * The tracker updates the uplink frequency only while the satellite is being tracked.
+		 * The link is considered down (and uplink frames are spooled) when the updates stop.
+		 */
+		atomic<uint64_t> link_seen(0);
+		csp_adapter.setLinkUp(false);
+		sdr.sinkTicks.connect([&] (Timestamp now) {
+			(void)now;
+			if (csp_adapter.isLinkUp() && tx_clock_ms() > link_seen + LINK_TIMEOUT)
+				csp_adapter.setLinkUp(false);
+		});
+		auto track_uplink = [&] (float frequency) {
+			modulator.setFrequencyOffset(frequency - center_frequency);
+			link_seen = tx_clock_ms();
+			csp_adapter.setLinkUp(true);
+		};
+#endif
+
 #ifdef USE_PORTHOUSE_TRACKER
 		// Setup porthouse tracker
 		PorthouseTracker tracker(cfg_tracker());
-		tracker.setUplinkFrequency.connect([&] (float frequency) {
-			modulator.setFrequencyOffset(frequency - center_frequency);
-		});
+		tracker.setUplinkFrequency.connect(track_uplink);
 		tracker.setDownlinkFrequency.connect([&] (float frequency) {
 			demodulator.setFrequencyOffset(frequency - center_frequency);
+			squelch.setFrequencyOffset(frequency - center_frequency);
 		});
 		sdr.sinkTicks.connect_member(&tracker, &PorthouseTracker::tick);
 #endif
@@ -165,11 +234,10 @@ int main(int argc, char *argv[])
 		 * Setup rigctl for frequency tracking
 		 */
 		RigCtl rigctl;
-		rigctl.setUplinkFrequency.connect([&] (float frequency) {
-			modulator.setFrequencyOffset(frequency - center_frequency);
-		});
+		rigctl.setUplinkFrequency.connect(track_uplink);
 		rigctl.setDownlinkFrequency.connect([&] (float frequency) {
 			demodulator.setFrequencyOffset(frequency - center_frequency);
+			squelch.setFrequencyOffset(frequency - center_frequency);
 		});
 		sdr.sinkTicks.connect_member(&rigctl, &RigCtl::tick);
 #endif
@@ -182,10 +250,12 @@ int main(int argc, char *argv[])
 		zmq_output_conf.bind = "tcp://0.0.0.0:7005";
 
 		ZMQPublisher zmq_output(zmq_output_conf);
+		mutex zmq_output_lock; // Uplink frames come from the TX sample buffer's thread
 		framer.sourceFrame.connect([&](Frame& frame, Timestamp now) {
 			csp_adapter.sourceFrame(frame, now);
 			if (frame.empty() == false) {
 				frame.setMetadata("packet_type", "uplink");
+				lock_guard<mutex> lock(zmq_output_lock);
 				zmq_output.sinkFrame(frame, now);
 			}
 		});
@@ -193,15 +263,71 @@ int main(int argc, char *argv[])
 		deframer.sinkFrame.connect([&](const Frame& frame, Timestamp now) {
 			Frame copy_frame(frame);
 			copy_frame.setMetadata("packet_type", "downlink");
+			lock_guard<mutex> lock(zmq_output_lock);
 			zmq_output.sinkFrame(copy_frame, now);
 		});
 
+#endif
+
+		/*
+		 * Clients can schedule a packet to a SDR time or a TDMA time slot
+		 * by sending csp_zmqserver_schedule_t after the packet. A scheduled packet
+		 * going to space is given directly to the adapter instead of the router.
+		 */
+		csp_zmqserver_set_schedule_callback(csp_zmq_if,
+			[](csp_packet_t *packet, const csp_zmqserver_schedule_t *schedule, void *arg) -> bool {
+				CSPSuoAdapter *adapter = static_cast<CSPSuoAdapter*>(arg);
+				const csp_route_t *route = csp_rtable_find_route(packet->id.dst);
+				if (route == NULL || route->iface != &adapter->csp_iface) {
+					csp_log_warn("Schedule ignored for a packet not going to space (dst %u)\n", packet->id.dst);
+					return false;
+				}
+
+				const uint64_t value = le64toh(schedule->value);
+				Timestamp tx_time;
+				if (schedule->type == CSP_ZMQSERVER_SCHEDULE_TIME)
+					tx_time = value;
+				else if (schedule->type == CSP_ZMQSERVER_SCHEDULE_SLOT)
+					tx_time = adapter->slotTime(value);
+				else {
+					csp_log_warn("Unknown schedule type %u\n", schedule->type);
+					return false;
+				}
+
+				// A scheduled packet which can't be queued is dropped rather than sent at a wrong time
+				if (adapter->transmitAt(packet, tx_time) != CSP_ERR_NONE)
+					csp_buffer_free(packet);
+				return true;
+			}, &csp_adapter);
+
+		/*
+		 * Reassembled SFP transfers go directly to the ZMQ clients
+		 */
+		csp_adapter.rxReassembled.connect([&](csp_id_t id, const uint8_t *data, size_t len) {
+			csp_zmqserver_publish_packet(csp_zmq_if, id, data, len);
+		});
+		sdr.sinkTicks.connect_member(&csp_adapter, &CSPSuoAdapter::tick);
+
+#ifdef OUTPUT_TX_EVENTS
+		/*
+		 * Uplink queued/modulated/dropped notifications for the ZMQ clients
+		 */
+		char event_endpoint[100];
+		snprintf(event_endpoint, sizeof(event_endpoint), "tcp://0.0.0.0:%u", CSP_ZMQSERVER_EVENT_PORT);
+		if (csp_zmqserver_init_events(csp_zmq_if, event_endpoint) != CSP_ERR_NONE)
+			throw SuoError("csp_zmqserver_init_events");
+
+		csp_adapter.txEvent.connect([&](const CSPSuoAdapter::TxEvent& event) {
+			csp_zmqserver_publish_event(csp_zmq_if, &event, sizeof(event));
+		});
 #endif
 
 		/*
 		 * Run!
 		 */
+		tx_buffer.start();
 		sdr.execute();
+		tx_buffer.stop();
 		cerr << "Suo exited" << endl;
 
 		return 0;
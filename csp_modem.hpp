@@ -10,6 +10,8 @@
 #include <modem/mod_gmsk.hpp>
 #include <framing/golay_framer.hpp>
 #include <framing/golay_deframer.hpp>
+#include "tx_sample_buffer.hpp"
+#include "squelch.hpp"
 #ifdef USE_PORTHOUSE_TRACKER
 #include <misc/porthouse_tracker.hpp>
 #endif
@@ -21,14 +23,20 @@ int csp_fec_append(csp_packet_t *packet);
 int csp_fec_decode(csp_packet_t *packet);
 int csp_apply_rand(csp_packet_t *packet);
 
+/* CCSDS pseudo random sequence (randomizer.cpp). Repeats every RANDOMIZER_LEN bytes. */
+#define RANDOMIZER_LEN   256
+extern const uint8_t csp_randomizer[RANDOMIZER_LEN];
+
 /*
  Functions returning config structs and implemented by SATELLITE_CONFIG_CPP
  */
 float cfg_center_frequency();
 SoapySDRIO::Config cfg_sdr();
 GMSKContinousDemodulator::Config cfg_gmsk_demodulator();
+Squelch::Config cfg_squelch();
 GolayDeframer::Config cfg_golay_deframer();
 GMSKModulator::Config cfg_gmsk_modulator();
+TxSampleBuffer::Config cfg_tx_sample_buffer();
 GolayFramer::Config cfg_golay_framer();
 CSPSuoAdapter::Config cfg_csp_suo_adapter();
 
@@ -11,15 +11,40 @@
 
 #ifdef LIBFEC
 #include "libfec/fec.h"
+
+static_assert(std::is_same_v<CSPReedSolomon, CCSDSReedSolomon>, "libfec implements only the CCSDS code");
 #endif
 
-#define CSP_RS_MSGLEN   223
-#define CSP_RS_PARITYS  32
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <type_traits>
+#include <endian.h>
+
 
 using namespace std;
 using namespace suo;
 
 
+/*
+ * Maximum number of erasures when decoding combined copies. 32 erasures would use all the
+ * parity and every wrong combination would "decode". 20 keeps capacity for 6 errors.
+ */
+#define RX_COMBINE_ERASURES  20
+
+/* Interval of retrying to move spooled frames to full TX queues [ms] */
+#define TX_SPOOL_RETRY  100
+
+/* Upper limit of rx_batch. Bounds the stack arrays of a batch. */
+#define RX_BATCH_MAX  32
+
+static_assert(CSP_RS_PARITYS == RX_KERNEL_NROOTS, "RX kernel computes the syndromes of a different code");
+
+
+/* CSP's HMAC and XTEA keys are global so the TX and RX threads must not use them at the same time. RX HMAC uses the key ring. */
+static mutex crypto_lock;
+
+
 CSPSuoAdapter::Config::Config() {
 	use_libfec = false;
 
@@ -28,29 +53,101 @@ CSPSuoAdapter::Config::Config() {
 	rx_use_crc = false;
 	rx_use_rand = false;
 	rx_legacy_hmac = false;
-	rx_hmac_key[16] = {0};
+	memset(rx_hmac_key, 0, sizeof(rx_hmac_key));
 	rx_use_xtea = false;
-	rx_xtea_key[20] = {0};
-	rx_filter_ground_addresses = true;
+	memset(rx_xtea_key, 0, sizeof(rx_xtea_key));
+	RxFilterRule ground("ground segment", false);
+	ground.src = RxFilterRule::range(9, 31);
+	rx_filter_rules.push_back(ground);
+	rx_filter_default_accept = true;
+	rx_workers = 2;
+	rx_queue_depth = 64;
+	rx_drop_oldest = false;
+	rx_batch = 8;
+	rx_max_erasures = 0;
+	rx_erasure_threshold = 32;
+	rx_combine_slots = 0;
+	rx_combine_window = 30000;
+	rx_combine_max_ber = 0.1;
+	rx_sfp_reassembly = false;
+	rx_sfp_max_size = 1024;
+	rx_sfp_connections = 4;
+	rx_sfp_timeout = 2000;
+	rx_diversity_station = 0;
+	rx_diversity_deliver = true;
+	rx_diversity_window = 5000;
+	rx_diversity_window_frames = 1024;
 
 	tx_use_hmac = false;
 	tx_use_rs = false;
 	tx_use_crc = false;
 	tx_use_rand = false;
 	tx_legacy_hmac = false;
-	tx_hmac_key[16] = {0};
+	memset(tx_hmac_key, 0, sizeof(tx_hmac_key));
 	tx_use_xtea = false;
-	tx_xtea_key[20] = {0};
+	memset(tx_xtea_key, 0, sizeof(tx_xtea_key));
+	tx_queue_depth = 32;
+	tx_weighted_scheduling = false;
+	for (unsigned int prio = 0; prio < TX_PRIORITIES; prio++) {
+		tx_priority_weights[prio] = 1;
+		tx_ttl[prio] = 0;
+	}
+	tx_burst_length = 1;
+	tx_symbol_rate = 0;
+	tx_interframe_gap = 0;
+	tx_burst_overhead = 0;
+	tx_frame_overhead = 0;
+	tx_spool_slots = 256;
+	tx_schedule_lead = 20000000;
+	tx_slot_length = 0;
+	tx_slot_count = 1;
+}
+
+
+/* RX HMAC keys in the order of the key ring */
+static vector<HmacKey> rx_hmac_keys(const CSPSuoAdapter::Config &conf) {
+	vector<HmacKey> keys;
+	if (conf.rx_use_hmac) {
+		HmacKey key;
+		memcpy(key.key, conf.rx_hmac_key, sizeof(key.key));
+		key.key_len = conf.rx_legacy_hmac ? 4 : 16;
+		keys.push_back(key);
+		keys.insert(keys.end(), conf.rx_hmac_keys.begin(), conf.rx_hmac_keys.end());
+	}
+	return keys;
 }
 
 
 CSPSuoAdapter::CSPSuoAdapter(const Config& _conf) :
 	conf(_conf),
-	tx_packet(nullptr),
-	tx_acked(true)
+	stats(),
+	tx_seq(0),
+	tx_input(TX_PRIORITIES * _conf.tx_queue_depth),
+	tx_input_sem(0),
+	tx_encoder_running(true),
+	tx_scheduler(_conf.tx_queue_depth, _conf.tx_weighted_scheduling, _conf.tx_priority_weights, _conf.tx_ttl),
+	tx_acked(true),
+	burst_frames(0),
+	burst_continuation(false),
+	tx_pacer(_conf.tx_symbol_rate, _conf.tx_interframe_gap),
+	tx_time_queue(_conf.tx_queue_depth),
+	sdr_time(0),
+	tx_frame_max(0),
+	scheduled_start(false),
+	scheduled_time(0),
+	rx_filter(_conf.rx_filter_rules, _conf.rx_filter_default_accept),
+	rx_hmac_keyring(rx_hmac_keys(_conf)),
+	rx_free(_conf.rx_queue_depth),
+	rx_input(_conf.rx_queue_depth),
+	rx_input_sem(0),
+	rx_running(true),
+	rx_seq(0),
+	rx_packet_size(0),
+	rx_reorder_mask(0),
+	rx_next(0),
+	link_up(true)
 {
 	memset(&csp_iface, 0, sizeof(csp_iface));
-	memset(&stats, 0, sizeof(stats));
 
 	/* Initialize CSP interface struct */
 	csp_iface.name = "SUO";
@@ -71,11 +168,77 @@ CSPSuoAdapter::CSPSuoAdapter(const Config& _conf) :
 	if (conf.tx_use_xtea)
 		csp_iface.mtu -= sizeof(uint32_t);  // Reserve space for nonce
 
+	// Longest frame the encoder can produce. Used to keep the air free for the scheduled bursts.
+	tx_frame_max = conf.tx_use_rs ? (CSP_RS_MSGLEN + CSP_RS_PARITYS) : (csp_buffer_data_size() + sizeof(csp_id_t));
+
+	if (conf.rx_max_erasures > CSP_RS_PARITYS)
+		throw SuoError("CSPSuoAdapter: rx_max_erasures over %d", CSP_RS_PARITYS);
+	if (conf.rx_batch == 0 || conf.rx_batch > RX_BATCH_MAX)
+		throw SuoError("CSPSuoAdapter: rx_batch must be 1...%d", RX_BATCH_MAX);
+
+	if (conf.tx_spool_path.empty() == false)
+		tx_spool.open(conf.tx_spool_path, conf.tx_spool_slots);
+
+	if (conf.rx_combine_slots > 0)
+		rx_codeword_combiner.reset(new CodewordCombiner(conf.rx_combine_slots, conf.rx_combine_window,
+		                                                conf.rx_combine_max_ber, RX_COMBINE_ERASURES));
+
+	if (conf.rx_sfp_reassembly) {
+		SfpReassembler::Config sfp_conf;
+		sfp_conf.max_size = conf.rx_sfp_max_size;
+		sfp_conf.connections = conf.rx_sfp_connections;
+		sfp_conf.timeout = conf.rx_sfp_timeout;
+		rx_sfp.reset(new SfpReassembler(sfp_conf));
+		rx_sfp->sinkPacket.connect([this](csp_id_t id, const uint8_t *data, size_t len) {
+			rxReassembled.emit(id, data, len);
+		});
+	}
+
+	if (conf.rx_diversity_publish.empty() == false || conf.rx_diversity_peers.empty() == false) {
+		DiversityCombiner::Config combiner_conf;
+		combiner_conf.station = conf.rx_diversity_station;
+		combiner_conf.publish = conf.rx_diversity_publish;
+		combiner_conf.peers = conf.rx_diversity_peers;
+		combiner_conf.deliver = conf.rx_diversity_deliver;
+		combiner_conf.window = conf.rx_diversity_window;
+		combiner_conf.window_frames = conf.rx_diversity_window_frames;
+		rx_combiner.reset(new DiversityCombiner(combiner_conf));
+		rx_combiner->deliverPacket.connect_member(this, &CSPSuoAdapter::routePacket);
+	}
+
 	csp_iface.nexthop = [](const csp_route_t *route, csp_packet_t *packet) -> int {
 		return static_cast<CSPSuoAdapter *>(route->iface->interface_data)->csp_transmit(packet);
 	};
 
-	csp_bin_sem_create(&tx_wait);
+	/* Start encoder thread */
+	tx_encoder = thread(&CSPSuoAdapter::txEncoderLoop, this);
+
+	/*
+	 * Pre-allocate the RX arena: Every job has memory for a received frame in the layout of a
+	 * CSP packet. The CSP buffer pool is left to the rest of the stack until a frame is accepted.
+	 */
+	rx_packet_size = csp_buffer_data_size();
+	const size_t stride = (sizeof(csp_packet_t) + rx_packet_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	rx_jobs.reset(new RxJob[rx_free.capacity()]);
+	rx_buffers.reset(new uint64_t[rx_free.capacity() * stride]);
+	for (size_t i = 0; i < rx_free.capacity(); i++) {
+		rx_jobs[i].packet = reinterpret_cast<csp_packet_t*>(&rx_buffers[i * stride]);
+		rx_free.push(&rx_jobs[i]);
+	}
+
+	/* Start RX workers */
+	if (conf.rx_workers > 0) {
+		// Sequence numbers of the jobs in flight and of the frames dropped in between fit in the reorder buffer
+		rx_reorder.resize(2 * rx_free.capacity(), RxSlot{nullptr, false});
+		rx_reorder_mask = rx_reorder.size() - 1;
+
+		for (unsigned int i = 0; i < conf.rx_workers; i++)
+			rx_threads.emplace_back(&CSPSuoAdapter::rxWorkerLoop, this);
+	}
+
+	/* Start receiving the other stations' packets */
+	if (rx_combiner)
+		rx_combiner->start();
 
 	/* Register interface */
 	csp_iflist_add(&csp_iface);
@@ -84,132 +247,426 @@ CSPSuoAdapter::CSPSuoAdapter(const Config& _conf) :
 
 CSPSuoAdapter::~CSPSuoAdapter() {
 	//cerr << "WARNING! CSPSuoAdapter destructor called!" << endl;
-	csp_bin_sem_remove(&tx_wait);
+
+	/* Stop the encoder thread */
+	tx_encoder_running = false;
+	tx_input_sem.release();
+	tx_encoder.join();
+
+	/* Stop the RX workers. Frames not yet delivered are discarded. */
+	rx_running = false;
+	rx_input_sem.release(rx_threads.size());
+	for (thread &worker: rx_threads)
+		worker.join();
+	if (rx_combiner)
+		rx_combiner->stop();
+
+	/* Release packets which were never transmitted */
+	TxEntry entry;
+	while (tx_input.pop(entry))
+		csp_buffer_free(entry.packet);
+	while (tx_scheduler.pop(entry))
+		csp_buffer_free(entry.packet);
+	while (tx_time_queue.pop(entry))
+		csp_buffer_free(entry.packet);
 }
 
 
 int CSPSuoAdapter::csp_transmit(csp_packet_t *packet) {
+	return transmitAt(packet, 0);
+}
 
-	if (tx_packet != nullptr) {
-		csp_log_warn("csp_transmit is busy!\n");
-		return CSP_ERR_BUSY; // CSP_ERR_AGAIN
-	}
+
+int CSPSuoAdapter::transmitAt(csp_packet_t *packet, Timestamp tx_time) {
 
 	csp_log_packet("\033[0;35m"
 	               "TX: Src %u, Dst %u, Dport %u, Sport %u, Pri %u, Flags 0x%02X, Size %" PRIu16,
 	               packet->id.src, packet->id.dst, packet->id.dport,
 	               packet->id.sport, packet->id.pri, packet->id.flags, packet->length);
 
+	TxEntry entry;
+	entry.packet = packet;
+	entry.id = packet->id;
+	entry.length = packet->length;
+	entry.seq = tx_seq++;
+	entry.deadline = 0;
+	entry.tx_time = tx_time;
 
-	// Make sure the waiting semaphore is not locked.
-	int ret = csp_bin_sem_wait(&tx_wait, 100);
-	if (ret != CSP_SEMAPHORE_OK) {
-		cerr << "Error: TX complete semaphora locked! " << ret << endl;
-		return CSP_ERR_BUSY;
+	// Hand the packet over to the encoder thread. The router thread never waits here.
+	// The packet is announced first so the events of the encoder thread can't overtake TX_QUEUED.
+	emitTxEvent(TX_QUEUED, entry);
+	if (tx_input.push(entry) == false) {
+		csp_log_warn("TX input queue full! (%u packets)\n", (unsigned int)tx_input.capacity());
+		stats.tx_dropped++;
+		emitTxEvent(TX_DROPPED, entry, TX_DROP_QUEUE_FULL);
+		return CSP_ERR_NOBUFS;
 	}
+	tx_input_sem.release();
 
-	// Signal the frame from CSP router thread to suo thread
-	tx_packet = packet;
+	stats.tx_queued++;
+	unsigned int level = getTxQueueLevel();
+	unsigned int peak = stats.tx_queue_peak;
+	while (level > peak && stats.tx_queue_peak.compare_exchange_weak(peak, level) == false);
 
-	// Wait until its released by the other task
-	ret = csp_bin_sem_wait(&tx_wait, 1000); 
-	if (ret != CSP_SEMAPHORE_OK) {
-		cerr << "Error: TX completed semaphora timed out! " << ret << endl;
-		return CSP_ERR_BUSY;
-	}
-	csp_bin_sem_wait(&tx_wait, 5); // Add time delay between frames.
-	csp_bin_sem_post(&tx_wait);
+	return CSP_ERR_NONE;
+}
+
+
+Timestamp CSPSuoAdapter::slotTime(unsigned int slot) const {
+	const Timestamp earliest = sdr_time + conf.tx_schedule_lead;
+	if (conf.tx_slot_length == 0 || conf.tx_slot_count == 0)
+		return earliest;
 
-	return 0;
+	const Timestamp period = conf.tx_slot_length * conf.tx_slot_count;
+	Timestamp tx_time = earliest - (earliest % period) + (slot % conf.tx_slot_count) * conf.tx_slot_length;
+	if (tx_time < earliest)
+		tx_time += period;
+	return tx_time;
 }
 
 
-void CSPSuoAdapter::sourceFrame(Frame &frame, Timestamp now)
-{
-	(void)now;
+void CSPSuoAdapter::txEncoderLoop() {
+
+	while (1) {
+		// Spooled frames waiting for room in the TX queues are retried periodically
+		if (drainSpool())
+			tx_input_sem.acquire();
+		else if (tx_input_sem.try_acquire_for(chrono::milliseconds(TX_SPOOL_RETRY)) == false)
+			continue;
+		if (tx_encoder_running == false)
+			break;
 
-	// Copy CSP packet from TX queue to Frame
-	if (tx_packet == nullptr) {
-		if (tx_acked == false) {
-			tx_acked = true;
-			//cout << "TX done" << endl;
-			csp_bin_sem_post(&tx_wait);
+		TxEntry entry;
+		if (tx_input.pop(entry) == false)
+			continue;
+
+		if (encodePacket(entry.packet) == false) {
+			csp_buffer_free(entry.packet);
+			stats.tx_encode_failed++;
+			emitTxEvent(TX_DROPPED, entry, TX_DROP_ENCODING);
+			continue;
+		}
+
+		if (entry.tx_time != 0) {
+			if (tx_time_queue.push(entry))
+				stats.tx_scheduled++;
+			else {
+				csp_log_warn("TX schedule full! (%u packets)\n", (unsigned int)tx_time_queue.size());
+				csp_buffer_free(entry.packet);
+				stats.tx_queue_full++;
+				emitTxEvent(TX_DROPPED, entry, TX_DROP_QUEUE_FULL);
+			}
+			continue;
+		}
+
+		// Link is down: Store the encoded frame until the next pass. Frames of the same
+		// priority still in the spool go first.
+		if (tx_spool.isOpen() && (link_up == false || tx_spool.size(entry.id.pri) > 0)) {
+			entry.deadline = tx_scheduler.deadline(entry.id.pri);
+			if (tx_spool.push(entry, (uint8_t *)&entry.packet->id, entry.packet->length))
+				stats.tx_spooled++;
+			else {
+				csp_log_warn("TX spool full! (%u frames)\n", (unsigned int)tx_spool.capacity());
+				stats.tx_spool_full++;
+				emitTxEvent(TX_DROPPED, entry, TX_DROP_QUEUE_FULL);
+			}
+			csp_buffer_free(entry.packet);
+			continue;
+		}
+
+		if (tx_scheduler.push(entry) == false) {
+			csp_log_warn("TX queue for priority %u full! (%u packets)\n", entry.id.pri, (unsigned int)tx_scheduler.capacity());
+			csp_buffer_free(entry.packet);
+			stats.tx_queue_full++;
+			emitTxEvent(TX_DROPPED, entry, TX_DROP_QUEUE_FULL);
 		}
-		return;
 	}
+}
 
-	tx_acked = false;
 
-	stats.tx_count++;
-	stats.tx_bytes += tx_packet->length;
+bool CSPSuoAdapter::drainSpool() {
+	if (link_up == false || tx_spool.isOpen() == false)
+		return true;
+
+	// The encoder thread is the only producer of the TX queues, so a queue with room stays so
+	for (unsigned int prio = 0; prio < TX_PRIORITIES; prio++) {
+		while (tx_scheduler.size(prio) < tx_scheduler.capacity() && tx_spool.size(prio) > 0) {
+			csp_packet_t *packet = static_cast<csp_packet_t*>(csp_buffer_get(csp_buffer_data_size()));
+			if (packet == NULL) {
+				csp_log_warn("TX spool: csp_buffer_get failed!\n");
+				return false;
+			}
+
+			TxEntry entry;
+			uint8_t frame[UPLINK_SPOOL_FRAME_MAX];
+			size_t len;
+			if (tx_spool.pop(prio, entry, frame, len) == false) {
+				csp_buffer_free(packet);
+				break;
+			}
+
+			if (entry.deadline != 0 && tx_clock_ms() > entry.deadline) {
+				csp_log_warn("Spooled TX packet expired! Src %u, Dst %u, Dport %u, Pri %u\n",
+				             entry.id.src, entry.id.dst, entry.id.dport, entry.id.pri);
+				csp_buffer_free(packet);
+				stats.tx_expired++;
+				emitTxEvent(TX_DROPPED, entry, TX_DROP_EXPIRED);
+				continue;
+			}
+
+			// The frame length includes the CSP header as in the encoded packets
+			memcpy(&packet->id, frame, len);
+			packet->length = len;
+			entry.packet = packet;
+			tx_scheduler.push(entry);
+		}
+	}
 
+	for (unsigned int prio = 0; prio < TX_PRIORITIES; prio++) {
+		if (tx_spool.size(prio) > 0)
+			return false;
+	}
+	return true;
+}
+
+
+bool CSPSuoAdapter::encodePacket(csp_packet_t *packet)
+{
 	/* Save the outgoing id in the buffer */
-	tx_packet->id.ext = csp_hton32(tx_packet->id.ext);
+	packet->id.ext = csp_hton32(packet->id.ext);
 
 	/* Calculate HMAC if selected */
 	if (conf.tx_use_hmac)
 	{
+		lock_guard<mutex> lock(crypto_lock);
 		csp_hmac_set_key(conf.tx_hmac_key, conf.tx_legacy_hmac ? 4 : 16);
-		int ret = csp_hmac_append(tx_packet, true);
+		int ret = csp_hmac_append(packet, true);
 		if (ret != CSP_ERR_NONE)
 		{
 			csp_log_warn("HMAC append failed %d\n", ret);
-			return;
+			return false;
 		}
 	}
 
 	/* Calculate CRC32 if selected */
 	if (conf.tx_use_crc)
 	{
-		int ret = csp_crc32_append(tx_packet, true);
+		int ret = csp_crc32_append(packet, true);
 		if (ret != CSP_ERR_NONE)
 		{
 			csp_log_warn("CRC32 append failed! %d\n", ret);
-			return;
+			return false;
 		}
 	}
 
 	/* Calculate XTEA encryption if selected */
 	if (conf.tx_use_xtea) {
 #if (CSP_USE_XTEA)
+		lock_guard<mutex> lock(crypto_lock);
 		csp_xtea_set_key(conf.tx_xtea_key, 20);
-		int ret = csp_xtea_encrypt_packet(tx_packet);
+		int ret = csp_xtea_encrypt_packet(packet);
 		if(ret != CSP_ERR_NONE) {
 			csp_log_warn("XTEA Encryption failed! %d\n", ret);
-			return;
+			return false;
 		}
 #else
 		csp_log_warn("Attempt to send XTEA encrypted packet, but CSP was compiled without XTEA support. Discarding packet\n");
-		return;
+		return false;
 #endif
 	}
 
 	if (conf.use_libfec && conf.tx_use_rs) {
 #ifdef LIBFEC
-		encode_rs_8((uint8_t *)&tx_packet->id, &tx_packet->data[tx_packet->length], CSP_RS_MSGLEN - tx_packet->length);
-		tx_packet->length += CSP_RS_PARITYS;
+		// The codeword covers the CSP header and data
+		const size_t message_len = sizeof(packet->id.ext) + packet->length;
+		encode_rs_8((uint8_t *)&packet->id, &packet->data[packet->length], CSP_RS_MSGLEN - message_len);
+		packet->length += CSP_RS_PARITYS;
 #else
 		csp_log_error("libfec not supported\n");
-		csp_buffer_free(tx_packet);
-		return;
+		return false;
 #endif
 	}
 
-	tx_packet->length += sizeof(tx_packet->id.ext);
+	/* From now on the length includes the CSP header */
+	packet->length += sizeof(packet->id.ext);
 
-	/* Copy data to Suo frame */
-	frame.data.resize(tx_packet->length);
-	memcpy(&frame.data[0], &tx_packet->id, tx_packet->length);
-	cout << frame.data;
+	/* Randomize data if necessary */
+	if (conf.tx_use_rand)
+		csp_apply_rand(packet);
 
-	csp_buffer_free(tx_packet);
-	tx_packet = nullptr;
+	return true;
+}
 
-	cout << frame;
+
+void CSPSuoAdapter::sourceFrame(Frame &frame, Timestamp now)
+{
+	sdr_time = now;
+
+	// If the previous request returned a frame, the framer is still transmitting and
+	// a frame given now continues the same burst.
+	const bool burst_ongoing = (tx_acked == false);
+	tx_acked = true;
+	if (burst_ongoing == false)
+		burst_frames = 0;
+	else
+		emitTxEvent(TX_MODULATED, tx_modulating, TX_DROP_NONE, now); // Previous frame is now completely modulated
+
+	// Burst has reached its maximum length. Let the modulator ramp down before the next preamble.
+	if (burst_frames >= conf.tx_burst_length) {
+		burst_frames = 0;
+		return;
+	}
+
+	TxEntry entry;
+	size_t frame_len;
+
+	// Scheduled frame always starts a new burst
+	const bool scheduled = (burst_ongoing == false && takeScheduledFrame(now, entry));
+	if (scheduled)
+		frame_len = copyFrame(frame, entry);
+	else {
+		// Keep the air free for the next scheduled burst
+		Timestamp next_scheduled;
+		if (tx_time_queue.peek(next_scheduled)) {
+			unsigned int symbols = conf.tx_frame_overhead + 8 * tx_frame_max;
+			if (burst_ongoing == false)
+				symbols += conf.tx_burst_overhead;
+			if (tx_pacer.fits(now, symbols, next_scheduled) == false)
+				return;
+		}
+
+		// Give the space segment time to receive the previous burst before starting a new one
+		if (burst_ongoing == false && tx_pacer.ready(now) == false) {
+			if (tx_scheduler.size() > 0)
+				stats.tx_paced++;
+			return;
+		}
+
+		// Don't radiate into nothing. Frames wait in the spool and in the queues for the next pass.
+		if (link_up == false && tx_spool.isOpen())
+			return;
+
+		// Pick the next encoded frame from the TX queues. Packets which have waited too long are dropped here.
+		while (1) {
+			if (tx_scheduler.pop(entry) == false)
+				return;
+
+			if (entry.deadline == 0 || tx_clock_ms() <= entry.deadline)
+				break;
+
+			csp_log_warn("TX packet expired! Src %u, Dst %u, Dport %u, Pri %u\n",
+			             entry.id.src, entry.id.dst, entry.id.dport, entry.id.pri);
+			csp_buffer_free(entry.packet);
+			stats.tx_expired++;
+			emitTxEvent(TX_DROPPED, entry, TX_DROP_EXPIRED);
+		}
+
+		frame_len = copyFrame(frame, entry);
+	}
+
+	stats.tx_count++;
+	stats.tx_bytes += frame_len;
+
+	burst_continuation = burst_ongoing;
+	if (burst_ongoing == false)
+		stats.tx_bursts++;
+	burst_frames++;
+	tx_acked = false;
+	tx_modulating = entry;
+
+	unsigned int airtime = conf.tx_frame_overhead + 8 * frame_len;
+	if (burst_ongoing == false)
+		airtime += conf.tx_burst_overhead;
+
+	if (scheduled) {
+		scheduled_start = true;
+		scheduled_time = entry.tx_time;
+		tx_pacer.transmitted(entry.tx_time, airtime);
+	}
+	else
+		tx_pacer.transmitted(now, airtime);
+}
+
+
+bool CSPSuoAdapter::takeScheduledFrame(Timestamp now, TxEntry &entry) {
+	Timestamp tx_time;
+	while (tx_time_queue.peek(tx_time)) {
+		if (tx_time > now + conf.tx_schedule_lead)
+			return false;
+
+		tx_time_queue.pop(entry);
+		if (tx_time >= now)
+			return true;
+
+		csp_log_warn("Scheduled TX packet late! Src %u, Dst %u, Dport %u, %.3f ms late\n",
+		             entry.id.src, entry.id.dst, entry.id.dport, 1e-6 * (now - tx_time));
+		csp_buffer_free(entry.packet);
+		stats.tx_late++;
+		emitTxEvent(TX_DROPPED, entry, TX_DROP_LATE);
+	}
+	return false;
+}
+
+
+size_t CSPSuoAdapter::copyFrame(Frame &frame, TxEntry &entry) {
+	const size_t len = entry.packet->length;
+	frame.data.resize(len);
+	memcpy(&frame.data[0], &entry.packet->id, len);
+
+	csp_buffer_free(entry.packet);
+	entry.packet = NULL;
+	return len;
+}
+
+
+void CSPSuoAdapter::setLinkUp(bool up) {
+	if (link_up.exchange(up) == up)
+		return;
+
+	if (up) {
+		csp_log_info("Uplink up, %u frames spooled\n", (unsigned int)tx_spool.size());
+		tx_input_sem.release(); // Encoder thread moves the spooled frames to the TX queues
+	}
+	else
+		csp_log_info("Uplink down\n");
+}
+
+
+void CSPSuoAdapter::emitTxEvent(TxEventType type, const TxEntry &entry, TxDropReason reason, Timestamp timestamp) {
+	TxEvent event;
+	event.type = type;
+	event.reason = reason;
+	event.seq = htole32(entry.seq);
+	event.id = htole32(entry.id.ext);
+	event.length = htole16(entry.length);
+	event.timestamp = htole64(timestamp);
+	txEvent.emit(event);
+}
+
+
+bool CSPSuoAdapter::takeBurstContinuation() {
+	bool ret = burst_continuation;
+	burst_continuation = false;
+	return ret;
+}
+
+
+bool CSPSuoAdapter::takeScheduledTime(Timestamp &tx_time) {
+	if (scheduled_start == false)
+		return false;
+	scheduled_start = false;
+	tx_time = scheduled_time;
+	return true;
 }
 
 
 void CSPSuoAdapter::sinkFrame(const Frame &frame, Timestamp now)
+{
+	sinkFrameWithReliability(frame, NULL, now);
+}
+
+
+void CSPSuoAdapter::sinkFrameWithReliability(const Frame &frame, const uint8_t *reliability, Timestamp now)
 {
 	(void)now;
 
@@ -220,131 +677,436 @@ void CSPSuoAdapter::sinkFrame(const Frame &frame, Timestamp now)
 		csp_log_warn("Too short frame! len: %lu\n", frame.size());
 		return;
 	}
+	if (frame.size() > sizeof(csp_id_t) + rx_packet_size) {
+		csp_log_warn("Too long frame! len: %lu\n", frame.size());
+		return;
+	}
 
-	// Allocate a new CSP frame
-	csp_packet_t *packet = static_cast<csp_packet_t*>(csp_buffer_get(frame.size() - sizeof(csp_id_t)));
-	if (packet == NULL)
-		throw SuoError("csp_buffer_get failed!");
+	RxJob *job = takeRxJob();
+	if (job == nullptr)
+		return;
 
-	memcpy(&packet->id, frame.data.data(), frame.size());
-	packet->length = frame.size();
-	
-	stats.rx_count++;
+	const unsigned int level = getRxPoolLevel();
+	if (level > stats.rx_pool_peak)
+		stats.rx_pool_peak = level;
 
-	/* Unrandomize data if necessary */
-	if (conf.rx_use_rand)
-		csp_apply_rand(packet);
+	// The only copy of the frame bytes. Everything else is done in place.
+	memcpy(&job->packet->id, frame.data.data(), frame.size());
+	job->packet->length = frame.size();
 
-	/* Decode Reed-Solomon if selected */
-	if (conf.rx_use_rs) {
-		if (conf.use_libfec) {
-			// Enough bytes for Reed-Solomon decoder?
-			if (packet->length < CSP_RS_PARITYS || packet->length > (CSP_RS_MSGLEN + CSP_RS_PARITYS)) {
-				csp_log_warn("Invalid frame length for Reed-Solomon decoder. len: %d\n", packet->length);
-				return;
+	job->has_reliability = (reliability != NULL && frame.size() <= sizeof(job->reliability));
+	if (job->has_reliability)
+		memcpy(job->reliability, reliability, frame.size());
+
+	job->snr = NAN;
+	auto snr = frame.metadata.find("snr");
+	if (snr != frame.metadata.end() && holds_alternative<float>(snr->second))
+		job->snr = get<float>(snr->second);
+
+	job->rs_bytes_corrected = 0;
+	job->rs_bits_corrected = 0;
+	if (conf.rx_use_rs && conf.use_libfec == false) {
+		// RS is used but decoding is implemented by suo.
+		// Increment statistics based on metadata inside the suo frame
+		try {
+			job->rs_bytes_corrected = get<unsigned int>(frame.metadata.at("rs_bytes_corrected"));
+			job->rs_bits_corrected = get<unsigned int>(frame.metadata.at("rs_bits_corrected"));
+		}
+		catch (std::out_of_range& e) {
+			cerr << "Frame missing field: " << e.what() << endl;
+		}
+	}
+
+	if (conf.rx_workers == 0) {
+		// Decode in the caller's thread
+		decodeFrame(*job);
+		deliverFrame(*job);
+		rx_free.push(job);
+		return;
+	}
+
+	// Decoding continues in a worker thread
+	job->seq = rx_seq++;
+	rx_input.push(job);
+	rx_input_sem.release();
+}
+
+
+CSPSuoAdapter::RxJob *CSPSuoAdapter::takeRxJob() {
+
+	RxJob *job;
+	const bool in_order = (conf.rx_workers == 0 || rx_seq - rx_next < rx_reorder.size());
+	if (in_order && rx_free.pop(job))
+		return job;
+
+	stats.rx_overflow++;
+
+	if (conf.rx_drop_oldest && conf.rx_workers > 0 && in_order && rx_input_sem.try_acquire()) {
+		if (rx_input.pop(job)) {
+			// Discard the oldest frame which no worker has started yet and reuse its buffer
+			csp_log_warn("RX pool full! Dropping the oldest frame\n");
+			lock_guard<mutex> lock(rx_delivery_lock);
+			rx_reorder[job->seq & rx_reorder_mask].skipped = true;
+			deliverInOrder();
+			return job;
+		}
+		rx_input_sem.release();
+	}
+
+	csp_log_warn("RX pool full! Dropping the frame\n");
+	return nullptr;
+}
+
+
+void CSPSuoAdapter::rxWorkerLoop() {
+
+	while (1) {
+		rx_input_sem.acquire();
+		if (rx_running == false)
+			break;
+
+		RxJob *batch[RX_BATCH_MAX];
+		size_t count = 0;
+		if (rx_input.pop(batch[count]))
+			count++;
+
+		// Take more frames if they are already waiting. A shutdown token is given back to the next worker.
+		while (count < conf.rx_batch && rx_input_sem.try_acquire()) {
+			if (rx_running == false || rx_input.pop(batch[count]) == false) {
+				rx_input_sem.release();
+				break;
 			}
+			count++;
+		}
+		if (count == 0)
+			continue;
+
+		decodeFrames(batch, count);
+
+		// Deliver the frames in the reception order
+		lock_guard<mutex> lock(rx_delivery_lock);
+		for (size_t i = 0; i < count; i++)
+			rx_reorder[batch[i]->seq & rx_reorder_mask].job = batch[i];
+		deliverInOrder();
+	}
+}
+
+
+void CSPSuoAdapter::deliverInOrder() {
+	while (1) {
+		RxSlot &slot = rx_reorder[rx_next & rx_reorder_mask];
+		if (slot.skipped)
+			slot.skipped = false;
+		else if (slot.job != nullptr) {
+			RxJob *job = slot.job;
+			slot.job = nullptr;
+			deliverFrame(*job);
+			rx_free.push(job);
+		}
+		else
+			break;
+		rx_next++;
+	}
+}
+
+
+void CSPSuoAdapter::deliverFrame(RxJob &job) {
+
+	stats.rx_count++;
+	stats.rx_corrected_bytes += job.corrected_bytes + job.rs_bytes_corrected;
+	stats.rx_bits_corrected += job.rs_bits_corrected;
+	if (job.failed)
+		stats.rx_failed++;
+	if (job.filtered)
+		stats.rx_filtered++;
+	if (job.erasure_decoded)
+		stats.rx_erasure_decoded++;
+	if (job.combined_copies > 0)
+		stats.rx_combined++;
+
+	if (job.accepted == false)
+		return;
+
+	// Only an accepted packet takes a buffer from the CSP pool
+	csp_packet_t *packet = static_cast<csp_packet_t*>(csp_buffer_get(job.packet->length));
+	if (packet == NULL) {
+		csp_log_warn("RX: csp_buffer_get failed!\n");
+		stats.rx_no_buffer++;
+		return;
+	}
+	packet->id = job.packet->id;
+	packet->length = job.packet->length;
+	memcpy(packet->data, job.packet->data, packet->length);
+	stats.rx_bytes += packet->length;
+
+	csp_log_packet("\033[0;36m"
+				   "RX: Src %u, Dst %u, Dport %u, Sport %u, Pri %u, Flags 0x%02X, Size %" PRIu16 ", HMAC key %d",
+				   packet->id.src, packet->id.dst, packet->id.dport,
+				   packet->id.sport, packet->id.pri, packet->id.flags, packet->length, job.hmac_key);
+
+	if (rx_combiner) {
+		// The combiner delivers the packet unless another station has already received it
+		RxQuality quality;
+		quality.corrected_bytes = job.corrected_bytes + job.rs_bytes_corrected;
+		quality.snr = job.snr;
+		rx_combiner->offerLocal(packet, quality);
+	}
+	else
+		routePacket(packet);
+}
+
+
+void CSPSuoAdapter::routePacket(csp_packet_t *packet) {
+	if (rx_sfp && SfpReassembler::isFragment(packet) && packet->id.dst != csp_get_address())
+		rx_sfp->push(packet);
+	else
+		csp_qfifo_write(packet, &csp_iface, NULL);
+}
+
+
+void CSPSuoAdapter::tick(Timestamp now) {
+	(void)now;
+	if (rx_sfp)
+		rx_sfp->tick();
+}
+
+
+void CSPSuoAdapter::decodeFrame(RxJob &job)
+{
+	RxJob *jobs[1] = { &job };
+	decodeFrames(jobs, 1);
+}
 
+
+void CSPSuoAdapter::decodeFrames(RxJob **jobs, size_t count)
+{
+	for (; count > RX_BATCH_MAX; jobs += RX_BATCH_MAX, count -= RX_BATCH_MAX)
+		decodeFrames(jobs, RX_BATCH_MAX);
+
+	bool ready[RX_BATCH_MAX];
+	for (size_t n = 0; n < count; n++)
+		ready[n] = prepareFrame(*jobs[n]);
+
+	/* Decode Reed-Solomon if selected */
+	if (conf.rx_use_rs && conf.use_libfec) {
 #ifdef LIBFEC
-			int ret = decode_rs_8((uint8_t *)&packet->id, NULL, 0, CSP_RS_MSGLEN + CSP_RS_PARITYS - packet->length);
+		/*
+		 * The RX kernel has computed the syndromes already. Codewords with errors are
+		 * decoded as a single batch so the decoder's tables stay in the cache.
+		 */
+		uint8_t *codewords[RX_BATCH_MAX];
+		int pads[RX_BATCH_MAX];
+		uint8_t syndromes[RX_BATCH_MAX * RX_KERNEL_NROOTS];
+		int corrected[RX_BATCH_MAX];
+		size_t dirty[RX_BATCH_MAX];
+		size_t no_dirty = 0;
+
+		for (size_t n = 0; n < count; n++) {
+			RxJob &job = *jobs[n];
+			if (ready[n] == false || job.pass.syndrome_error == false)
+				continue;
+			job.crc_valid = false;
+			codewords[no_dirty] = (uint8_t *)&job.packet->id;
+			pads[no_dirty] = CSP_RS_MSGLEN + CSP_RS_PARITYS - job.packet->length;
+			memcpy(&syndromes[no_dirty * RX_KERNEL_NROOTS], job.pass.syndromes, RX_KERNEL_NROOTS);
+			dirty[no_dirty++] = n;
+		}
+
+		if (no_dirty > 0)
+			decode_rs_8_batch(codewords, pads, syndromes, corrected, no_dirty);
+
+		for (size_t d = 0; d < no_dirty; d++) {
+			RxJob &job = *jobs[dirty[d]];
+			int ret = corrected[d];
+			if (ret < 0)
+				ret = recoverCodeword(job);
 			if (ret < 0) {
 				csp_log_error("Failed to decode RS");
-				csp_buffer_free(packet);
-				stats.rx_failed++;
-				return;
+				job.failed = true;
+				ready[dirty[d]] = false;
+				continue;
 			}
+			job.corrected_bytes = ret;
+		}
 
-			csp_log_info("RS corrected %d errors", ret);
-			stats.rx_corrected_bytes += ret;
+		for (size_t n = 0; n < count; n++) {
+			if (ready[n] == false)
+				continue;
+			csp_log_info("RS corrected %d errors", jobs[n]->corrected_bytes);
+			jobs[n]->packet->length -= CSP_RS_PARITYS;
+		}
 
 #if 0
-			/* Count bit errors */
-			unsigned int corrected_bits = 0;
-			const uint8_t* original = static_cast<uint8_t*>(&packet->id); // TODO
-			const uint8_t* corrected = static_cast<uint8_t *>(&packet->id);
-			for (unsigned int i = 0; i < packet->length; i++)
-				corrected_bits += popcount(original[i] ^ corrected[i]);
-			stats.rx_bits_corrected += corrected_bits;
+		/* Count bit errors */
+		unsigned int corrected_bits = 0;
+		const uint8_t* original = static_cast<uint8_t*>(&packet->id); // TODO
+		const uint8_t* corrected = static_cast<uint8_t *>(&packet->id);
+		for (unsigned int i = 0; i < packet->length; i++)
+			corrected_bits += popcount(original[i] ^ corrected[i]);
+		job.rs_bits_corrected += corrected_bits;
 #endif
 #else
-			csp_log_error("libfec not supported\n");
-			csp_buffer_free(packet);
-			return;
-#endif
+		csp_log_error("libfec not supported\n");
+		for (size_t n = 0; n < count; n++) {
+			jobs[n]->failed = true;
+			ready[n] = false;
 		}
-		else {
-			// RS is used but decoding is implemented by suo.
-			// Increment statistics based on metadata inside the suo frame
-			try {
-				stats.rx_corrected_bytes += get<unsigned int>(frame.metadata.at("rs_bytes_corrected"));
-				stats.rx_bits_corrected += get<unsigned int>(frame.metadata.at("rs_bits_corrected"));
-			}
-			catch (std::out_of_range& e) {
-				cerr << "Frame missing field: " << e.what() << endl;
-			}
+#endif
+	}
+
+	for (size_t n = 0; n < count; n++) {
+		if (ready[n])
+			verifyFrame(*jobs[n]);
+	}
+}
+
+
+bool CSPSuoAdapter::prepareFrame(RxJob &job)
+{
+	csp_packet_t *packet = job.packet;
+	job.accepted = false;
+	job.failed = false;
+	job.filtered = false;
+	job.erasure_decoded = false;
+	job.combined_copies = 0;
+	job.hmac_key = -1;
+	job.corrected_bytes = 0;
+
+	/*
+	 * Derandomize, compute the RS syndromes and the CRC32 in a single pass over the frame.
+	 * The CRC covers the CSP header and data without the CRC itself. It is valid
+	 * only if the RS decoder doesn't touch the data and there is no encryption.
+	 */
+	const bool rs_length_ok = (packet->length >= CSP_RS_PARITYS && packet->length <= (CSP_RS_MSGLEN + CSP_RS_PARITYS));
+	const bool rx_syndromes = conf.rx_use_rs && conf.use_libfec && rs_length_ok;
+	const size_t message_len = packet->length - (rx_syndromes ? CSP_RS_PARITYS : 0);
+	size_t crc_len = 0;
+	if (conf.rx_use_crc && conf.rx_use_xtea == false && message_len >= sizeof(csp_id_t) + sizeof(uint32_t))
+		crc_len = message_len - sizeof(uint32_t);
+
+	rx_kernel((uint8_t *)&packet->id, packet->length, conf.rx_use_rand, rx_syndromes, crc_len, job.pass);
+	job.crc_valid = (crc_len > 0);
+
+	// Enough bytes for Reed-Solomon decoder?
+	if (conf.rx_use_rs && conf.use_libfec && rs_length_ok == false) {
+		csp_log_warn("Invalid frame length for Reed-Solomon decoder. len: %d\n", packet->length);
+		job.failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+
+int CSPSuoAdapter::recoverCodeword(RxJob &job)
+{
+	int ret = -1;
+#ifdef LIBFEC
+	csp_packet_t *packet = job.packet;
+	uint8_t *codeword = (uint8_t *)&packet->id;
+	const int pad = CSP_RS_MSGLEN + CSP_RS_PARITYS - packet->length;
+
+	if (job.has_reliability && conf.rx_max_erasures > 0) {
+		// Too many errors. Retry marking the least reliable bytes as erasures.
+		int eras_pos[CSP_RS_PARITYS];
+		const int no_eras = select_erasures(job.reliability, packet->length, conf.rx_max_erasures,
+		                                    conf.rx_erasure_threshold, eras_pos);
+		if (no_eras > 0) {
+			// libfec takes the positions in the full length block
+			for (int i = 0; i < no_eras; i++)
+				eras_pos[i] += pad;
+			ret = decode_rs_8(codeword, eras_pos, no_eras, pad);
+			if (ret >= 0)
+				job.erasure_decoded = true;
 		}
 	}
 
+	if (ret < 0 && rx_codeword_combiner) {
+		// Combine with the earlier failed copies of the same frame
+		ret = rx_codeword_combiner->recover(codeword, packet->length, job.has_reliability ? job.reliability : NULL,
+			[pad](uint8_t *data, int *eras_pos, int no_eras) {
+				for (int i = 0; i < no_eras; i++)
+					eras_pos[i] += pad;
+				return decode_rs_8(data, eras_pos, no_eras, pad);
+			}, job.combined_copies);
+		if (ret >= 0)
+			csp_log_info("RS recovered by combining %u copies", job.combined_copies);
+	}
+#else
+	(void)job;
+#endif
+	return ret;
+}
+
+
+void CSPSuoAdapter::verifyFrame(RxJob &job)
+{
+	csp_packet_t *packet = job.packet;
+
 	// Make sure there are enough bytes after RS decoder.
-	if (packet->length >= sizeof(csp_id_t)) {
+	if (packet->length < sizeof(csp_id_t)) {
 		csp_log_warn("Too short frame after decoding! len: %d\n", packet->length);
+		job.failed = true;
 		return;
 	}
 
 	/* The CSP packet length is without the header */
-	packet->length = frame.size() - sizeof(csp_id_t);
+	packet->length -= sizeof(csp_id_t);
+
+	/* Header based filtering before the expensive decryption and verification. The header stays in network order for them. */
+	csp_id_t id;
+	id.ext = csp_ntoh32(packet->id.ext);
+	int rule;
+	if (rx_filter.match(id, rule) == false) {
+		csp_log_info("Frame filtered (%s)", (rule >= 0) ? rx_filter.getRules()[rule].name.c_str() : "default");
+		job.filtered = true;
+		return;
+	}
 
 	/* XTEA encrypted packet */
 	if (conf.rx_use_xtea) {
+		lock_guard<mutex> lock(crypto_lock);
 		csp_xtea_set_key(conf.rx_xtea_key, 20);
 		if (csp_xtea_decrypt_packet(packet) != CSP_ERR_NONE)
 		{
 			csp_log_error("Decryption failed! Discarding packet");
-			csp_buffer_free(packet);
-			stats.rx_failed++;
+			job.failed = true;
 			return;
 		}
 	}
 
 	/* Validate CRC32 */
 	if (conf.rx_use_crc) {
-		int ret = csp_crc32_verify(packet, true);
+		int ret;
+		if (job.crc_valid) {
+			// Computed already by the RX kernel
+			const uint32_t crc = csp_hton32(job.pass.crc);
+			ret = (memcmp(&packet->data[packet->length - sizeof(crc)], &crc, sizeof(crc)) == 0) ? CSP_ERR_NONE : CSP_ERR_CRC32;
+			if (ret == CSP_ERR_NONE)
+				packet->length -= sizeof(crc);
+		}
+		else
+			ret = csp_crc32_verify(packet, true);
 		if (ret != CSP_ERR_NONE)
 		{
 			csp_log_warn("CRC failed %d", ret);
-			csp_buffer_free(packet);
-			stats.rx_failed++;
+			job.failed = true;
 			return;
 		}
 	}
 
 	/* Verify HMAC if selected */
 	if (conf.rx_use_hmac) {
-		csp_hmac_set_key(conf.rx_hmac_key, conf.rx_legacy_hmac ? 4 : 16);
-		int ret = csp_hmac_verify(packet, true);
-		if (ret != CSP_ERR_NONE) {
-			csp_log_error("HMAC error %d", ret);
-			csp_buffer_free(packet);
-			stats.rx_failed++;
+		job.hmac_key = rx_hmac_keyring.verify(packet, true, id.src);
+		if (job.hmac_key < 0) {
+			csp_log_error("HMAC error: No matching key");
+			job.failed = true;
 			return;
 		}
 	}
 
 	/* Convert the packet from network to host order */
-	packet->id.ext = csp_ntoh32(packet->id.ext);
-
-	/* Ignore frame if source port indicates that is coming from ground segment. */
-	if (conf.rx_filter_ground_addresses && packet->id.src > 8) {
-		csp_log_info("Frame filtered");
-		csp_buffer_free(packet);
-		return;
-	}
-
-	stats.rx_bytes += packet->length;
-
-	csp_log_packet("\033[0;36m"
-				   "RX: Src %u, Dst %u, Dport %u, Sport %u, Pri %u, Flags 0x%02X, Size %" PRIu16,
-				   packet->id.src, packet->id.dst, packet->id.dport,
-				   packet->id.sport, packet->id.pri, packet->id.flags, packet->length);
+	packet->id.ext = id.ext;
 
-	csp_qfifo_write(packet, &csp_iface, NULL);
+	job.accepted = true;
 }
@@ -3,8 +3,26 @@
 #include <suo.hpp>
 #include <zmq.hpp>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <semaphore>
+
 #include <csp/csp.h>
-#include <csp/arch/csp_semaphore.h>
+
+#include "codeword_combiner.hpp"
+#include "diversity_combiner.hpp"
+#include "hmac_key_ring.hpp"
+#include "rx_filter.hpp"
+#include "reed_solomon.hpp"
+#include "rx_kernel.hpp"
+#include "sfp_reassembler.hpp"
+#include "symbol_reliability.hpp"
+#include "tx_scheduler.hpp"
+#include "uplink_spool.hpp"
 
 /* 
  * Suo block to connect
@@ -24,11 +42,86 @@ public:
 		bool rx_legacy_hmac;
 		uint8_t rx_hmac_key[16];
 
+		/*
+		 * Additional HMAC keys, e.g. for other satellites or a key rotation. The keys bound to
+		 * the packet's source address are tried first. rx_hmac_key is always key 0.
+		 */
+		std::vector<HmacKey> rx_hmac_keys;
+
 		bool rx_use_xtea;
 		uint8_t rx_xtea_key[20];
 
-		/* Filter out frames which originate from ground segment. */
-		bool rx_filter_ground_addresses;
+		/*
+		 * Received packet filter applied to the RS corrected header before the decryption and
+		 * verification. The first matching rule decides. By default the frames originating
+		 * from the ground segment (src > 8) are dropped.
+		 */
+		std::vector<RxFilterRule> rx_filter_rules;
+		bool rx_filter_default_accept;   // Action for the frames matching no rule
+
+		/*
+		 * Number of threads decoding and verifying the received frames. The frames are
+		 * delivered to CSP in the reception order. 0 = decode in the caller's (DSP) thread.
+		 */
+		unsigned int rx_workers;
+
+		/*
+		 * Size of the RX arena: Maximum number of received frames being decoded or waiting
+		 * for the workers. The arena has its own memory. A CSP buffer is taken only when an
+		 * accepted packet is delivered, so the depth doesn't count against csp_conf.buffers.
+		 */
+		unsigned int rx_queue_depth;
+
+		/* When the arena is full, drop the oldest frame not yet being decoded instead of the new frame */
+		bool rx_drop_oldest;
+
+		/*
+		 * Maximum number of queued frames a worker takes at a time. Their Reed-Solomon
+		 * codewords are decoded together with decode_rs_8_batch. 1 = one frame at a time, max 32.
+		 */
+		unsigned int rx_batch;
+
+		/*
+		 * Erasure assisted RS decoding (use_libfec): If a frame has too many errors, decoding is
+		 * retried marking the least reliable bytes as erasures. Requires the byte reliabilities
+		 * given to sinkFrameWithReliability. Up to CSP_RS_PARITYS erasures. 0 disables.
+		 * Each erasure uses one parity byte: Keep a margin (e.g. 20) so that wrong decodings are still detected.
+		 */
+		unsigned int rx_max_erasures;
+		uint8_t rx_erasure_threshold;    // Only bytes less reliable than this are erased (0-127)
+
+		/*
+		 * Combining of repeated frames failing RS (use_libfec, see CodewordCombiner): Failed codewords
+		 * are kept for rx_combine_window. When another copy of the same frame (same length and at most
+		 * rx_combine_max_ber of the bits differing) fails, the copies are combined by a bitwise vote and
+		 * decoding is retried. 0 slots disables.
+		 */
+		unsigned int rx_combine_slots;   // Maximum number of failed codewords kept
+		unsigned int rx_combine_window;  // [ms]
+		float rx_combine_max_ber;
+
+		/*
+		 * Diversity combining of several receiving stations (see DiversityCombiner): Every station
+		 * publishes its decoded packets to rx_diversity_publish. The combining station subscribes
+		 * to the others' rx_diversity_peers and delivers each packet to CSP once. The other stations
+		 * set rx_diversity_deliver to false. Empty publish endpoint and peer list disable combining.
+		 */
+		unsigned int rx_diversity_station;            // Identifier of this station
+		std::string rx_diversity_publish;              // ZMQ endpoint to bind, e.g. "tcp://0.0.0.0:7010"
+		std::vector<std::string> rx_diversity_peers;   // ZMQ endpoints of the other stations
+		bool rx_diversity_deliver;
+		unsigned int rx_diversity_window;             // Deduplication window [ms]
+		unsigned int rx_diversity_window_frames;      // Maximum number of packets in the window
+
+		/*
+		 * SFP reassembly (see SfpReassembler): Fragments of the small fragment protocol which are
+		 * not addressed to the modem itself are coalesced per connection into fragments of up to
+		 * rx_sfp_max_size bytes and emitted through rxReassembled instead of routing them via CSP.
+		 */
+		bool rx_sfp_reassembly;
+		unsigned int rx_sfp_max_size;      // [bytes] including the SFP trailer
+		unsigned int rx_sfp_connections;   // Maximum number of transfers in progress
+		unsigned int rx_sfp_timeout;       // [ms]
 
 		bool tx_use_hmac;
 		bool tx_use_rs;
@@ -39,14 +132,108 @@ public:
 
 		bool tx_use_xtea;
 		uint8_t tx_xtea_key[20];
+
+		/* Maximum number of packets waiting for transmission in each priority queue */
+		unsigned int tx_queue_depth;
+
+		/* Use weighted round-robin between CSP priorities instead of strict priority */
+		bool tx_weighted_scheduling;
+		unsigned int tx_priority_weights[TX_PRIORITIES];
+
+		/* Maximum time a packet can wait in the queue for each CSP priority [ms]. 0 = no limit */
+		unsigned int tx_ttl[TX_PRIORITIES];
+
+		/*
+		 * Maximum number of frames transmitted back-to-back after a single preamble.
+		 * Following frames in the burst are separated only by the syncword. 1 disables the burst mode.
+		 */
+		unsigned int tx_burst_length;
+
+		/*
+		 * Uplink pacing: A new burst is started only after the modulator has finished
+		 * the previous one and tx_interframe_gap symbols have elapsed.
+		 * Airtime of a frame is estimated assuming 8 symbols per byte.
+		 */
+		float tx_symbol_rate;            // Modulator symbol rate [symbols/s]. 0 disables the pacing.
+		unsigned int tx_interframe_gap;  // Idle time between bursts, e.g. receiver turnaround [symbols]
+		unsigned int tx_burst_overhead;  // Preamble and ramps added to every burst [symbols]
+		unsigned int tx_frame_overhead;  // Syncword, header and parity added by the framer to every frame [symbols]
+
+		/*
+		 * Store-and-forward: While the link is down (see setLinkUp), encoded frames are
+		 * stored to a memory mapped spool file. When the link comes up, they are moved to
+		 * the priority queues behind the frames queued before the link went down. The tx_ttl
+		 * deadline is kept in wall clock time, also over a restart, and expired frames are
+		 * dropped. Empty path disables the spool.
+		 */
+		std::string tx_spool_path;
+		unsigned int tx_spool_slots;     // Maximum number of frames in the spool
+
+		/*
+		 * Scheduled transmissions (see transmitAt): A scheduled frame starts its own burst exactly
+		 * at the requested SDR time. It is given to the modulator tx_schedule_lead before the time.
+		 * Other bursts are held back if they wouldn't be finished before the next scheduled burst
+		 * (requires tx_symbol_rate).
+		 */
+		suo::Timestamp tx_schedule_lead;  // [ns]
+
+		/* TDMA frame for slot requests (see slotTime): tx_slot_count slots of tx_slot_length starting from SDR time 0 */
+		suo::Timestamp tx_slot_length;    // [ns]. 0 = slots not in use
+		unsigned int tx_slot_count;
+	};
+
+	/*
+	 * Uplink packet life cycle event.
+	 * The layout is also the wire format of the TX event ZMQ messages.
+	 * All the fields are little endian.
+	 */
+	enum TxEventType : uint8_t {
+		TX_QUEUED = 1,    // Accepted from CSP to the TX queue
+		TX_MODULATED = 2, // Frame has been completely modulated. It reaches the air after the TX sample buffer.
+		TX_DROPPED = 3,   // Discarded before transmission
+	};
+
+	enum TxDropReason : uint8_t {
+		TX_DROP_NONE = 0,
+		TX_DROP_QUEUE_FULL = 1,
+		TX_DROP_ENCODING = 2,
+		TX_DROP_EXPIRED = 3,
+		TX_DROP_LATE = 4,       // Scheduled time had already passed
+	};
+
+	struct __attribute__((packed)) TxEvent {
+		uint8_t type;          // TxEventType
+		uint8_t reason;        // TxDropReason
+		uint32_t seq;          // Modem's sequence number for the packet
+		uint32_t id;           // CSP header (csp_id_t.ext)
+		uint16_t length;       // CSP payload length
+		uint64_t timestamp;    // Estimated SDR time at the end of the modulated frame [ns]. 0 for other events
 	};
 
 	struct Stats {
 		unsigned int tx_count;
 		unsigned int tx_bytes;
+		std::atomic<unsigned int> tx_queued;   // transmitAt is called by the CSP router and the ZMQ server threads
+		std::atomic<unsigned int> tx_dropped;
+		unsigned int tx_encode_failed;
+		unsigned int tx_queue_full;
+		std::atomic<unsigned int> tx_expired;  // Counted by the encoder thread (spool) and the modulator thread
+		std::atomic<unsigned int> tx_queue_peak;
+		unsigned int tx_bursts;
+		unsigned int tx_paced;
+		unsigned int tx_spooled;
+		unsigned int tx_spool_full;
+		unsigned int tx_scheduled;
+		unsigned int tx_late;
 		unsigned int rx_count;
 		unsigned int rx_bytes;
 		unsigned int rx_failed;
+		unsigned int rx_filtered;    // Frames dropped by the header filter
+		unsigned int rx_erasure_decoded; // Frames recovered using erasures
+		unsigned int rx_combined;    // Frames recovered by combining repeated copies
+		unsigned int rx_overflow;    // Frames dropped because the RX arena was full
+		unsigned int rx_no_buffer;   // Accepted frames dropped because the CSP buffer pool was exhausted
+		unsigned int rx_pool_peak;   // Maximum number of RX arena buffers in use
 		unsigned int rx_corrected_bytes;
 		unsigned int rx_bits_corrected;
 	};
@@ -66,18 +253,208 @@ public:
 	/* Sink a received frame  to be transmitted (suo callback function) */
 	void sinkFrame(const suo::Frame &frame, suo::Timestamp now);
 
+	/*
+	 * Sink a received frame with the reliability of each byte (see SymbolReliability)
+	 * for erasure decoding. reliability can be NULL.
+	 */
+	void sinkFrameWithReliability(const suo::Frame &frame, const uint8_t *reliability, suo::Timestamp now);
+
+	/*
+	 * Returns true (only once per frame) if the latest frame given to the framer continues
+	 * an ongoing burst and so its preamble should not be transmitted.
+	 */
+	bool takeBurstContinuation();
+
+	/*
+	 * Returns true (only once per frame) if the latest frame given to the framer is scheduled
+	 * and its burst must start exactly at the returned SDR time.
+	 */
+	bool takeScheduledTime(suo::Timestamp &tx_time);
+
 	/* Callback function for CSP. Called when a packet should be outputted. */
 	int csp_transmit(csp_packet_t *packet);
 
+	/*
+	 * Transmit a packet so that its burst starts at the given SDR time [ns]. 0 = as soon as possible.
+	 * Returns CSP_ERR_NONE if the packet was accepted, otherwise the caller still owns the packet.
+	 * Can be called from any thread.
+	 */
+	int transmitAt(csp_packet_t *packet, suo::Timestamp tx_time);
+
+	/* Start time of the next occurrence of a TDMA time slot at least tx_schedule_lead from now [ns] */
+	suo::Timestamp slotTime(unsigned int slot) const;
+
+	/* Latest SDR time seen by the adapter [ns] */
+	suo::Timestamp getSdrTime() const { return sdr_time; }
+
+	/* Number of packets currently waiting for encoding or transmission */
+	size_t getTxQueueLevel() const { return tx_input.size() + tx_scheduler.size() + tx_time_queue.size() + tx_spool.size(); }
+
+	/*
+	 * Set the uplink state, e.g. at AOS and LOS. Nothing is transmitted while the link is
+	 * down if the spool is enabled. The link is up by default. Can be called from any thread.
+	 */
+	void setLinkUp(bool up);
+	bool isLinkUp() const { return link_up; }
+
+	const Stats& getStats() const { return stats; }
+
+	/* HMAC keys of the received packets and their match counters */
+	const HmacKeyRing& getRxHmacKeys() const { return rx_hmac_keyring; }
+
+	/* Diversity combiner or NULL if combining is not in use */
+	const DiversityCombiner* getDiversityCombiner() const { return rx_combiner.get(); }
+
+	/* Received packet filter and its per rule hit counters */
+	const RxFilter& getRxFilter() const { return rx_filter; }
+
+	/* Number of RX arena buffers in use */
+	size_t getRxPoolLevel() const { return rx_free.capacity() - rx_free.size(); }
+
+	/* Flush the stalled SFP transfers. Call periodically, e.g. from the SDR ticks. */
+	void tick(suo::Timestamp now);
+
+	/* SFP reassembler or NULL if the reassembly is not in use */
+	const SfpReassembler* getSfpReassembler() const { return rx_sfp.get(); }
+
+	/* Reassembled SFP packets (CSP header, payload with the SFP trailer, length). Emitted from the RX threads. */
+	suo::Port<csp_id_t, const uint8_t*, size_t> rxReassembled;
+
+	/* Uplink packet life cycle events. Emitted from the CSP router, encoder and suo threads. */
+	suo::Port<const TxEvent&> txEvent;
+
 	csp_iface_t csp_iface;
 
 private:
+	/* Encode the packet in place for transmission (HMAC, CRC32, XTEA, RS, randomizer) */
+	bool encodePacket(csp_packet_t *packet);
+
+	/* TX encoder thread main loop */
+	void txEncoderLoop();
+
+	/*
+	 * Move spooled frames to the TX queues while the link is up and the queues have room.
+	 * Returns false if frames are left waiting for room.
+	 */
+	bool drainSpool();
+
+	/* Take a scheduled frame which is due now. Late frames are dropped. */
+	bool takeScheduledFrame(suo::Timestamp now, TxEntry &entry);
+
+	/* Copy encoded packet to the suo frame and release the packet */
+	size_t copyFrame(suo::Frame &frame, TxEntry &entry);
+
+	/* Received frame on its way from the DSP thread to CSP */
+	struct RxJob {
+		uint32_t seq;                     // Reception order
+		csp_packet_t *packet;             // Arena memory holding the frame. Decoded in place. Not a CSP buffer.
+		unsigned int rs_bytes_corrected;  // Corrections made by suo's RS decoder
+		unsigned int rs_bits_corrected;
+		unsigned int corrected_bytes;     // Corrections made by the adapter's RS decoder
+		bool failed;                      // Decoding or verification failed
+		bool filtered;                    // Dropped by the header filter
+		bool erasure_decoded;             // RS decoding succeeded only with erasures
+		unsigned int combined_copies;     // Number of copies combined to recover the frame. 0 if not combined.
+		int hmac_key;                     // Index of the key verifying the HMAC. -1 if not verified.
+		float snr;                        // From the frame metadata [dB]. NaN if not known.
+		bool has_reliability;
+		uint8_t reliability[CSP_RS_MSGLEN + CSP_RS_PARITYS]; // Reliability of the frame bytes
+		RxKernelResult pass;              // Syndromes and CRC from the RX kernel
+		bool crc_valid;                   // pass.crc can be used for the CRC32 check
+		bool accepted;                    // Packet is passed to CSP
+	};
+
+	/* Reorder buffer slot */
+	struct RxSlot {
+		RxJob *job;                       // Decoded frame waiting for delivery
+		bool skipped;                     // Frame was dropped
+	};
+
+	/* Take a free job from the RX arena applying the drop policy. NULL if the frame must be dropped. */
+	RxJob *takeRxJob();
+
+	/* Deliver the decoded frames which are next in order. Called with rx_delivery_lock held. */
+	void deliverInOrder();
+
+	/* Decode and verify a received frame (RS, XTEA, CRC32, HMAC) */
+	void decodeFrame(RxJob &job);
+
+	/* Decode and verify received frames. The RS codewords having errors are decoded as a batch. */
+	void decodeFrames(RxJob **jobs, size_t count);
+
+	/* Derandomize and run the RX kernel. Returns false if the frame can't be decoded. */
+	bool prepareFrame(RxJob &job);
+
+	/* Recover a codeword which failed RS decoding with erasures or combining. Returns the decoder's result. */
+	int recoverCodeword(RxJob &job);
+
+	/* Verification after RS decoding (filter, XTEA, CRC32, HMAC) */
+	void verifyFrame(RxJob &job);
+
+	/* Update the RX statistics and pass the decoded packet to CSP */
+	void deliverFrame(RxJob &job);
+
+	/* Pass a received packet to CSP or to the SFP reassembly */
+	void routePacket(csp_packet_t *packet);
+
+	/* RX worker thread main loop */
+	void rxWorkerLoop();
+
+	void emitTxEvent(TxEventType type, const TxEntry &entry, TxDropReason reason = TX_DROP_NONE, suo::Timestamp timestamp = 0);
+
 	Config conf;
 	Stats stats;
 
-	csp_bin_sem_handle_t tx_wait;
-	csp_packet_t * tx_packet;
+	/* Packets from the CSP router and the transmitAt callers waiting for the encoder thread */
+	std::atomic<uint32_t> tx_seq;
+	LockFreeQueue<TxEntry> tx_input;
+	std::counting_semaphore<> tx_input_sem;
+	std::atomic<bool> tx_encoder_running;
+	std::thread tx_encoder;
+
+	/* Encoded frames handed over from the encoder thread to the suo thread */
+	TxScheduler tx_scheduler;
 	bool tx_acked;
+	TxEntry tx_modulating;         // Frame currently being modulated
+
+	unsigned int burst_frames;     // Number of frames sent in the current burst
+	bool burst_continuation;       // Latest frame continues the burst without a preamble
+
+	TxPacer tx_pacer;
+
+	/* Frames scheduled to a specific time */
+	TxTimeQueue tx_time_queue;
+	std::atomic<suo::Timestamp> sdr_time;
+	size_t tx_frame_max;           // Maximum length of an encoded frame [bytes]
+	bool scheduled_start;          // Latest frame begins a scheduled burst
+	suo::Timestamp scheduled_time;
+
+	RxFilter rx_filter;
+	HmacKeyRing rx_hmac_keyring;
+	std::unique_ptr<DiversityCombiner> rx_combiner;
+	std::unique_ptr<CodewordCombiner> rx_codeword_combiner;
+	std::unique_ptr<SfpReassembler> rx_sfp;
+
+	/* RX arena and worker pool. Jobs are recycled through rx_free. */
+	std::unique_ptr<RxJob[]> rx_jobs;
+	std::unique_ptr<uint64_t[]> rx_buffers;   // Frame memory of the jobs
+	LockFreeQueue<RxJob*> rx_free;
+	LockFreeQueue<RxJob*> rx_input;
+	std::counting_semaphore<> rx_input_sem;
+	std::atomic<bool> rx_running;
+	std::vector<std::thread> rx_threads;
+	uint32_t rx_seq;                      // Next sequence number given by the DSP thread
+	size_t rx_packet_size;                // Size of the arena buffers [bytes]
+
+	/* Decoded frames waiting for their turn to be delivered */
+	std::mutex rx_delivery_lock;
+	std::vector<RxSlot> rx_reorder;
+	size_t rx_reorder_mask;
+	std::atomic<uint32_t> rx_next;        // Sequence number of the next frame to be delivered
+
+	/* Store-and-forward spool for frames encoded while the link is down */
+	UplinkSpool tx_spool;
+	std::atomic<bool> link_up;
 
 };
 
@@ -0,0 +1,289 @@
+#include "diversity_combiner.hpp"
+#include "tx_scheduler.hpp"
+
+#include <zmq.h>
+#include <endian.h>
+#include <math.h>
+#include <string.h>
+
+#include <csp/csp_endian.h>
+
+using namespace std;
+using namespace suo;
+
+
+#define DIVERSITY_VERSION  1
+
+/* Message published for every decoded packet. Followed by the CSP payload. (little endian) */
+struct __attribute__((packed)) DiversityHeader {
+	uint8_t version;
+	uint8_t station;
+	uint16_t corrected_bytes;
+	int16_t snr;              // [0.1 dB]. INT16_MIN if not known
+	uint16_t length;          // CSP payload length
+	uint32_t id;              // CSP header in network byte order
+};
+
+
+/* FNV-1a hash of the CSP header and payload identifying the copies of a packet */
+static uint64_t packet_key(uint32_t id, const uint8_t *data, size_t len) {
+	uint64_t hash = 14695981039346656037ULL;
+	const uint8_t *header = reinterpret_cast<const uint8_t*>(&id);
+	for (size_t i = 0; i < sizeof(id); i++)
+		hash = (hash ^ header[i]) * 1099511628211ULL;
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	return hash;
+}
+
+
+DiversityCombiner::Config::Config() {
+	station = 0;
+	deliver = true;
+	window = 5000;
+	window_frames = 1024;
+}
+
+
+DiversityCombiner::DiversityCombiner(const Config &_conf) :
+	conf(_conf),
+	context(nullptr),
+	publisher(nullptr),
+	subscriber(nullptr),
+	running(false)
+{
+	memset(&stats, 0, sizeof(stats));
+
+	if (conf.station >= DIVERSITY_MAX_STATIONS)
+		throw SuoError("DiversityCombiner: Invalid station %u", conf.station);
+
+	context = zmq_ctx_new();
+
+	// The destructor isn't run if the constructor throws
+	try {
+		if (conf.publish.empty() == false) {
+			publisher = zmq_socket(context, ZMQ_PUB);
+			if (zmq_bind(publisher, conf.publish.c_str()) < 0)
+				throw SuoError("DiversityCombiner: Failed to bind %s: %s", conf.publish.c_str(), zmq_strerror(zmq_errno()));
+		}
+
+		if (conf.peers.empty() == false) {
+			subscriber = zmq_socket(context, ZMQ_SUB);
+			zmq_setsockopt(subscriber, ZMQ_SUBSCRIBE, "", 0);
+			const int timeout = 100; // [ms] for checking the stop request
+			zmq_setsockopt(subscriber, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+			for (const string &peer: conf.peers)
+				if (zmq_connect(subscriber, peer.c_str()) < 0)
+					throw SuoError("DiversityCombiner: Failed to connect %s: %s", peer.c_str(), zmq_strerror(zmq_errno()));
+		}
+	}
+	catch (...) {
+		close();
+		throw;
+	}
+}
+
+
+DiversityCombiner::~DiversityCombiner() {
+	stop();
+	close();
+}
+
+
+void DiversityCombiner::close() {
+	if (publisher != nullptr)
+		zmq_close(publisher);
+	if (subscriber != nullptr)
+		zmq_close(subscriber);
+	if (context != nullptr)
+		zmq_ctx_term(context);
+	publisher = subscriber = context = nullptr;
+}
+
+
+void DiversityCombiner::start() {
+	if (running || subscriber == nullptr)
+		return;
+	running = true;
+	receiver = thread(&DiversityCombiner::receiverLoop, this);
+}
+
+
+void DiversityCombiner::stop() {
+	running = false;
+	if (receiver.joinable())
+		receiver.join();
+}
+
+
+DiversityCombiner::Stats DiversityCombiner::getStats() const {
+	lock_guard<mutex> guard(lock);
+	return stats;
+}
+
+
+bool DiversityCombiner::isNew(uint64_t key, unsigned int station, const RxQuality &quality) {
+
+	// Forget the packets which have fallen out of the window
+	const uint64_t now = tx_clock_ms();
+	while (seen_order.empty() == false) {
+		auto it = seen.find(seen_order.front());
+		if (seen_order.size() <= conf.window_frames && it != seen.end() && it->second.time + conf.window > now)
+			break;
+		if (it != seen.end())
+			seen.erase(it);
+		seen_order.pop_front();
+	}
+
+	auto it = seen.find(key);
+	if (it != seen.end()) {
+		Seen &entry = it->second;
+		if (entry.copies[station] < UINT16_MAX)
+			entry.copies[station]++;
+
+		// Copy of a delivered transmission received by another station
+		if (entry.copies[station] <= entry.delivered) {
+			stats.duplicates++;
+			if (quality.corrected_bytes < entry.corrected_bytes) {
+				stats.best[entry.station]--;
+				stats.best[station]++;
+				entry.corrected_bytes = quality.corrected_bytes;
+				entry.station = station;
+			}
+			return false;
+		}
+
+		// The station has received the packet again, so it was transmitted again
+		entry.time = now;
+		entry.corrected_bytes = quality.corrected_bytes;
+		entry.station = station;
+		entry.delivered++;
+		stats.first[station]++;
+		stats.best[station]++;
+		return true;
+	}
+
+	Seen entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.time = now;
+	entry.corrected_bytes = quality.corrected_bytes;
+	entry.station = station;
+	entry.delivered = 1;
+	entry.copies[station] = 1;
+	seen[key] = entry;
+	seen_order.push_back(key);
+
+	stats.first[station]++;
+	stats.best[station]++;
+	return true;
+}
+
+
+void DiversityCombiner::publishPacket(const csp_packet_t *packet, const RxQuality &quality) {
+
+	DiversityHeader header;
+	header.version = DIVERSITY_VERSION;
+	header.station = conf.station;
+	header.corrected_bytes = htole16(quality.corrected_bytes);
+	header.snr = htole16(isnan(quality.snr) ? INT16_MIN : (int16_t)lrintf(quality.snr * 10));
+	header.length = htole16(packet->length);
+	header.id = csp_hton32(packet->id.ext);
+
+	zmq_msg_t msg;
+	zmq_msg_init_size(&msg, sizeof(header) + packet->length);
+	uint8_t *data = static_cast<uint8_t*>(zmq_msg_data(&msg));
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + sizeof(header), packet->data, packet->length);
+
+	if (zmq_msg_send(&msg, publisher, ZMQ_DONTWAIT) < 0) {
+		csp_log_warn("Diversity: Publish failed: %s", zmq_strerror(zmq_errno()));
+		zmq_msg_close(&msg);
+	}
+}
+
+
+void DiversityCombiner::offerLocal(csp_packet_t *packet, const RxQuality &quality) {
+
+	unique_lock<mutex> guard(lock);
+	stats.local++;
+
+	if (publisher != nullptr)
+		publishPacket(packet, quality);
+
+	if (conf.deliver == false) {
+		guard.unlock();
+		csp_buffer_free(packet);
+		return;
+	}
+
+	const uint32_t id = csp_hton32(packet->id.ext);
+	if (isNew(packet_key(id, packet->data, packet->length), conf.station, quality) == false) {
+		guard.unlock();
+		csp_buffer_free(packet);
+		return;
+	}
+
+	stats.delivered++;
+	guard.unlock();
+	deliverPacket.emit(packet);
+}
+
+
+void DiversityCombiner::receiverLoop() {
+
+	while (running) {
+		zmq_msg_t msg;
+		zmq_msg_init(&msg);
+		if (zmq_msg_recv(&msg, subscriber, 0) < 0) {
+			zmq_msg_close(&msg);
+			continue; // Timeout
+		}
+
+		const uint8_t *data = static_cast<const uint8_t*>(zmq_msg_data(&msg));
+		const size_t size = zmq_msg_size(&msg);
+		DiversityHeader header;
+		if (size < sizeof(header)) {
+			zmq_msg_close(&msg);
+			continue;
+		}
+		memcpy(&header, data, sizeof(header));
+
+		const size_t length = le16toh(header.length);
+		if (header.version != DIVERSITY_VERSION || header.station >= DIVERSITY_MAX_STATIONS ||
+		    size != sizeof(header) + length) {
+			csp_log_warn("Diversity: Invalid message of %u bytes", (unsigned int)size);
+			zmq_msg_close(&msg);
+			continue;
+		}
+
+		RxQuality quality;
+		quality.corrected_bytes = le16toh(header.corrected_bytes);
+		const int16_t snr = (int16_t)le16toh(header.snr);
+		quality.snr = (snr == INT16_MIN) ? NAN : snr / 10.0f;
+
+		const uint8_t *payload = data + sizeof(header);
+		unique_lock<mutex> guard(lock);
+		stats.remote++;
+		if (isNew(packet_key(header.id, payload, length), header.station, quality) == false) {
+			zmq_msg_close(&msg);
+			continue;
+		}
+
+		csp_packet_t *packet = static_cast<csp_packet_t*>(csp_buffer_get(length));
+		if (packet == NULL) {
+			stats.no_buffer++;
+			zmq_msg_close(&msg);
+			continue;
+		}
+		stats.delivered++;
+		guard.unlock();
+
+		packet->id.ext = csp_ntoh32(header.id);
+		packet->length = length;
+		memcpy(packet->data, payload, length);
+		zmq_msg_close(&msg);
+
+		csp_log_info("Diversity: Packet from station %u (%u corrected)", header.station, quality.corrected_bytes);
+		deliverPacket.emit(packet);
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#include <suo.hpp>
+#include <csp/csp.h>
+
+/* Maximum number of receiving stations */
+#define DIVERSITY_MAX_STATIONS  16
+
+
+/*
+ * Reception quality of a decoded frame
+ */
+struct RxQuality {
+	unsigned int corrected_bytes;  // Bytes corrected by the Reed-Solomon decoder
+	float snr;                     // [dB]. NaN if not known.
+};
+
+
+/*
+ * Combines the downlink frames decoded by several receiving stations.
+ *
+ * Every station publishes its decoded packets with the reception quality over ZMQ.
+ * The combining station subscribes to the other stations and delivers each packet
+ * once: The first verified copy is delivered and the copies of the same packet
+ * from the other stations arriving within the deduplication window are dropped.
+ * Copies passing the verification are bit-identical, so no copy is worth waiting for.
+ * A station receiving the same packet again (e.g. an RDP retransmission) has received
+ * a new transmission, which is delivered again. The quality tells which station's
+ * copy was the best, for the statistics.
+ */
+class DiversityCombiner
+{
+public:
+	struct Config {
+		Config();
+
+		unsigned int station;             // Identifier of this station (0...DIVERSITY_MAX_STATIONS-1)
+		std::string publish;              // ZMQ endpoint to bind for publishing the local frames. Empty = don't publish.
+		std::vector<std::string> peers;   // ZMQ endpoints of the other stations. Empty = don't combine.
+		bool deliver;                     // Deliver the packets to CSP (false = only publish)
+		unsigned int window;              // Deduplication window [ms]
+		unsigned int window_frames;       // Maximum number of packets remembered in the window
+	};
+
+	struct Stats {
+		unsigned int local;                               // Packets decoded by this station
+		unsigned int remote;                              // Packets received from the other stations
+		unsigned int duplicates;                          // Copies dropped
+		unsigned int delivered;
+		unsigned int first[DIVERSITY_MAX_STATIONS];       // Delivered copies by station
+		unsigned int best[DIVERSITY_MAX_STATIONS];        // Least corrected copies by station
+		unsigned int no_buffer;                           // Remote packets dropped because the CSP buffer pool was exhausted
+	};
+
+	explicit DiversityCombiner(const Config &conf = Config());
+	~DiversityCombiner();
+
+	DiversityCombiner(const DiversityCombiner &) = delete;
+	DiversityCombiner &operator=(const DiversityCombiner &) = delete;
+
+	/* Start/stop receiving from the other stations */
+	void start();
+	void stop();
+
+	/*
+	 * Offer a packet decoded by this station (header in host byte order). The combiner takes
+	 * the ownership of the packet and delivers it through deliverPacket or frees it.
+	 */
+	void offerLocal(csp_packet_t *packet, const RxQuality &quality);
+
+	/* Packets to be passed to CSP. Emitted from the caller's thread or the combiner's thread. */
+	suo::Port<csp_packet_t*> deliverPacket;
+
+	Stats getStats() const;
+
+private:
+	/* Packet seen within the window */
+	struct Seen {
+		uint64_t time;                 // [ms]
+		unsigned int corrected_bytes;  // Least corrections of the copies
+		unsigned int station;          // Station with the least corrections
+		unsigned int delivered;        // Number of transmissions delivered
+		uint16_t copies[DIVERSITY_MAX_STATIONS];  // Copies received by each station
+	};
+
+	/*
+	 * Returns true if the packet is seen for the first time or the station has received
+	 * it more times than it has been delivered. Called with lock held.
+	 */
+	bool isNew(uint64_t key, unsigned int station, const RxQuality &quality);
+
+	void publishPacket(const csp_packet_t *packet, const RxQuality &quality);
+
+	/* Close the ZMQ sockets and the context */
+	void close();
+	void receiverLoop();
+
+	Config conf;
+	Stats stats;
+
+	mutable std::mutex lock;
+	std::unordered_map<uint64_t, Seen> seen;
+	std::deque<uint64_t> seen_order;     // Keys in the order of arrival for expiring
+
+	void *context;
+	void *publisher;
+	void *subscriber;
+	std::atomic<bool> running;
+	std::thread receiver;
+};
@@ -0,0 +1,91 @@
+#include "hmac_key_ring.hpp"
+
+#include <csp/crypto/csp_hmac.h>
+#include <string.h>
+
+using namespace std;
+
+
+HmacKey::HmacKey() :
+	key_len(16),
+	src(-1)
+{
+	memset(key, 0, sizeof(key));
+}
+
+
+HmacKeyRing::HmacKeyRing(const vector<HmacKey> &keys) {
+
+	for (const HmacKey &key: keys) {
+		KeyContext ctx;
+		ctx.src = key.src;
+
+		// Like csp_hmac_set_key: The first 16 bytes of the key's SHA1 is used as the HMAC key
+		uint8_t hash[CSP_SHA1_DIGESTSIZE];
+		csp_sha1_memory(key.key, min<unsigned int>(key.key_len, sizeof(key.key)), hash);
+
+		uint8_t ipad[CSP_SHA1_BLOCKSIZE], opad[CSP_SHA1_BLOCKSIZE];
+		memset(ipad, 0x36, sizeof(ipad));
+		memset(opad, 0x5c, sizeof(opad));
+		for (unsigned int i = 0; i < 16; i++) {
+			ipad[i] ^= hash[i];
+			opad[i] ^= hash[i];
+		}
+
+		csp_sha1_init(&ctx.inner);
+		csp_sha1_process(&ctx.inner, ipad, sizeof(ipad));
+		csp_sha1_init(&ctx.outer);
+		csp_sha1_process(&ctx.outer, opad, sizeof(opad));
+
+		contexts.push_back(ctx);
+	}
+
+	// The source's own keys first, then the rest in the configured order
+	for (unsigned int src = 0; src < 32; src++) {
+		for (unsigned int i = 0; i < contexts.size(); i++)
+			if (contexts[i].src == (int)src)
+				order[src].push_back(i);
+		for (unsigned int i = 0; i < contexts.size(); i++)
+			if (contexts[i].src != (int)src)
+				order[src].push_back(i);
+	}
+
+	matches.reset(new atomic<unsigned int>[contexts.size()]);
+	for (unsigned int i = 0; i < contexts.size(); i++)
+		matches[i] = 0;
+}
+
+
+bool HmacKeyRing::check(const KeyContext &ctx, const csp_packet_t *packet, bool include_header) {
+
+	const uint32_t len = packet->length - CSP_HMAC_LENGTH;
+	uint8_t digest[CSP_SHA1_DIGESTSIZE];
+
+	csp_sha1_state state = ctx.inner;
+	if (include_header)
+		csp_sha1_process(&state, (const uint8_t *)&packet->id, sizeof(packet->id));
+	csp_sha1_process(&state, packet->data, len);
+	csp_sha1_done(&state, digest);
+
+	state = ctx.outer;
+	csp_sha1_process(&state, digest, sizeof(digest));
+	csp_sha1_done(&state, digest);
+
+	return memcmp(&packet->data[len], digest, CSP_HMAC_LENGTH) == 0;
+}
+
+
+int HmacKeyRing::verify(csp_packet_t *packet, bool include_header, uint8_t src) {
+
+	if (packet->length < CSP_HMAC_LENGTH)
+		return -1;
+
+	for (int key: order[src & 31]) {
+		if (check(contexts[key], packet, include_header)) {
+			matches[key]++;
+			packet->length -= CSP_HMAC_LENGTH;
+			return key;
+		}
+	}
+	return -1;
+}
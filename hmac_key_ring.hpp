@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+#include <csp/csp.h>
+#include <csp/crypto/csp_sha1.h>
+
+
+/* HMAC key of the received packets */
+struct HmacKey {
+	HmacKey();
+
+	uint8_t key[16];
+	unsigned int key_len;  // Bytes of the key in use: 16, or 4 for the legacy HMAC
+	int src;               // CSP source address using the key. -1 = any
+};
+
+
+/*
+ * Set of HMAC keys for verifying the received packets, e.g. several satellites
+ * or the old and new key during a key rotation.
+ *
+ * The result is the same as csp_hmac_verify with the key set by csp_hmac_set_key,
+ * but the inner and outer SHA1 states of each key are precomputed, so verifying
+ * a packet costs the same as with a single key and no global state is used.
+ * The keys of the packet's source address are tried first, then the rest of the keys.
+ * Thread safe after construction.
+ */
+class HmacKeyRing
+{
+public:
+	explicit HmacKeyRing(const std::vector<HmacKey> &keys = {});
+
+	HmacKeyRing(const HmacKeyRing &) = delete;
+	HmacKeyRing &operator=(const HmacKeyRing &) = delete;
+
+	size_t size() const { return contexts.size(); }
+
+	/*
+	 * Verify and remove the HMAC of a packet. The header is hashed as it is in the buffer.
+	 * src: Source address of the packet used to select the key.
+	 * Returns the index of the matching key or -1 if no key matched.
+	 */
+	int verify(csp_packet_t *packet, bool include_header, uint8_t src);
+
+	/* Number of packets verified with a key */
+	unsigned int getMatches(unsigned int key) const { return matches[key]; }
+
+private:
+	struct KeyContext {
+		csp_sha1_state inner;  // State after hashing key ^ ipad
+		csp_sha1_state outer;  // State after hashing key ^ opad
+		int src;
+	};
+
+	bool check(const KeyContext &ctx, const csp_packet_t *packet, bool include_header);
+
+	std::vector<KeyContext> contexts;
+	std::vector<int> order[32];   // Keys to try for each source address
+	std::unique_ptr<std::atomic<unsigned int>[]> matches;
+};
@@ -20,6 +20,11 @@
  * PRIM - The primitive root of the generator poly. Integer variable or literal.
  * DEBUG - If set to 1 or more, do various internal consistency checking. Leave this
  *         undefined for production code
+ * SYNDROMES - Optional address of NROOTS precomputed syndromes in polynomial form.
+ *             If given, they are used instead of evaluating data(x).
+ * CHIEN_SEARCH - Optional function (lambda, deg_lambda, root, loc) replacing the Chien search.
+ *                lambda is in index form. Stores the roots and the error locations in
+ *                increasing order of root and returns their number.
 
  * The memset(), memmove(), and memcpy() functions are used. The appropriate header
  * file declaring these functions (usually <string.h>) must be included by the calling
@@ -78,6 +83,10 @@
   data_t root[NROOTS], reg[NROOTS+1], loc[NROOTS];
   int syn_error, count;
 
+#ifdef SYNDROMES
+  /* syndromes given by the caller in polynomial form */
+  memcpy(s, SYNDROMES, NROOTS*sizeof(s[0]));
+#else
   /* form the syndromes; i.e., evaluate data(x) at roots of g(x) */
   for(i=0;i<NROOTS;i++)
     s[i] = data[0];
@@ -91,6 +100,7 @@
       }
     }
   }
+#endif
 
   /* Convert syndromes to index form, checking for nonzero condition */
   syn_error = 0;
@@ -213,6 +223,10 @@
       deg_lambda = i;
   }
   /* Find roots of the error+erasure locator polynomial by Chien search */
+#ifdef CHIEN_SEARCH
+  count = CHIEN_SEARCH(lambda, deg_lambda, root, loc);
+  (void)reg; (void)q; (void)k;
+#else
   memcpy(&reg[1],&lambda[1],NROOTS*sizeof(reg[0]));
   count = 0;		/* Number of roots of lambda(x) */
   for (i = 1,k=IPRIM-1; i <= NN; i++,k = MODNN(k+IPRIM)) {
@@ -237,6 +251,7 @@
     if(++count == deg_lambda)
       break;
   }
+#endif
   if (deg_lambda != count) {
     /*
      * deg(lambda) unequal to number of roots => uncorrectable
@@ -14,14 +14,166 @@
 #pragma GCC push_options
 #pragma GCC optimize ("O3")
 
-int decode_rs_8(data_t *data, int *eras_pos, int no_eras, int pad){
+#if __x86_64__
+/* rs_8_x86.c */
+int rs_8_x86_tier(void);
+int syndromes_rs_8_ssse3(const data_t *data, data_t *syndromes, int pad);
+int syndromes_rs_8_avx2(const data_t *data, data_t *syndromes, int pad);
+int syndromes_rs_8_gfni(const data_t *data, data_t *syndromes, int pad);
+int chien_rs_8_avx2(const data_t *lambda, int deg_lambda, data_t *root, data_t *loc);
+int chien_rs_8_gfni(const data_t *lambda, int deg_lambda, data_t *root, data_t *loc);
+
+static int tier = -1;
+
+static int simd_tier(void){
+  if(tier < 0)
+    tier = rs_8_x86_tier();
+  return tier;
+}
+#endif
+
+/* Chien search of decode_rs.h. lambda is in index form. */
+static int chien_rs_8(const data_t *lambda, int deg_lambda, data_t *root, data_t *loc){
+  int i, j, k, count;
+  data_t q, reg[NROOTS+1];
+
+#if __x86_64__
+  switch(simd_tier()){
+  case 3:
+    return chien_rs_8_gfni(lambda, deg_lambda, root, loc);
+  case 2:
+    return chien_rs_8_avx2(lambda, deg_lambda, root, loc);
+  }
+#endif
+
+  /* Portable version as in decode_rs.h */
+  memcpy(&reg[1],&lambda[1],NROOTS*sizeof(reg[0]));
+  count = 0;
+  for (i = 1,k=IPRIM-1; i <= NN; i++,k = MODNN(k+IPRIM)) {
+    q = 1;
+    for (j = deg_lambda; j > 0; j--){
+      if (reg[j] != NN) {
+	reg[j] = MODNN(reg[j] + j);
+	q ^= ALPHA_TO[reg[j]];
+      }
+    }
+    if (q != 0)
+      continue;
+    root[count] = i;
+    loc[count] = k;
+    if(++count == deg_lambda)
+      break;
+  }
+  return count;
+}
+
+/* Same as decode_rs_8 but the syndromes have already been computed by the caller */
+int decode_rs_8_syndromes(data_t *data, const data_t *syndromes, int *eras_pos, int no_eras, int pad){
   int retval;
 
   if(pad < 0 || pad > 222){
     return -1;
   }
 
+#define SYNDROMES syndromes
+#define CHIEN_SEARCH chien_rs_8
 #include "decode_rs.h"
+#undef CHIEN_SEARCH
+#undef SYNDROMES
 
   return retval;
 }
+
+
+int syndromes_rs_8(const data_t *data, data_t *syndromes, int pad){
+  int i, j;
+  data_t syn_error;
+
+#if __x86_64__
+  switch(simd_tier()){
+  case 3:
+    return syndromes_rs_8_gfni(data, syndromes, pad);
+  case 2:
+    return syndromes_rs_8_avx2(data, syndromes, pad);
+  case 1:
+    return syndromes_rs_8_ssse3(data, syndromes, pad);
+  }
+#endif
+
+  /* Portable version as in decode_rs.h */
+  for(i=0;i<NROOTS;i++)
+    syndromes[i] = data[0];
+
+  for(j=1;j<NN-pad;j++){
+    for(i=0;i<NROOTS;i++){
+      if(syndromes[i] == 0){
+	syndromes[i] = data[j];
+      } else {
+	syndromes[i] = data[j] ^ ALPHA_TO[MODNN(INDEX_OF[syndromes[i]] + (FCR+i)*PRIM)];
+      }
+    }
+  }
+
+  syn_error = 0;
+  for(i=0;i<NROOTS;i++)
+    syn_error |= syndromes[i];
+  return syn_error != 0;
+}
+
+int decode_rs_8(data_t *data, int *eras_pos, int no_eras, int pad){
+  data_t syndromes[NROOTS];
+
+  if(pad < 0 || pad > 222){
+    return -1;
+  }
+
+  /* All syndromes zero: data[] is a codeword and there's nothing to correct */
+  if(!syndromes_rs_8(data, syndromes, pad))
+    return 0;
+
+  return decode_rs_8_syndromes(data, syndromes, eras_pos, no_eras, pad);
+}
+
+/* Number of codewords whose syndromes are computed before decoding them */
+#define BATCH_CHUNK 16
+
+int decode_rs_8_batch(data_t **data, const int *pads, const data_t *syndromes, int *corrected, int n){
+  data_t chunk_syndromes[BATCH_CHUNK][NROOTS];
+  int dirty[BATCH_CHUNK];
+  int first, i, decoded = 0;
+
+  for(first=0;first<n;first+=BATCH_CHUNK){
+    const int len = MIN(BATCH_CHUNK, n - first);
+
+    /* Syndromes of the whole chunk first while the syndrome tables are in the cache */
+    for(i=0;i<len;i++){
+      const int c = first + i;
+      if(pads[c] < 0 || pads[c] > 222){
+        dirty[i] = -1;
+      } else if(syndromes != NULL){
+        int r;
+        data_t syn_error = 0;
+        memcpy(chunk_syndromes[i], &syndromes[c*NROOTS], NROOTS);
+        for(r=0;r<NROOTS;r++)
+          syn_error |= chunk_syndromes[i][r];
+        dirty[i] = (syn_error != 0);
+      } else {
+        dirty[i] = syndromes_rs_8(data[c], chunk_syndromes[i], pads[c]);
+      }
+    }
+
+    /* Full decoder only for the codewords having errors */
+    for(i=0;i<len;i++){
+      const int c = first + i;
+      if(dirty[i] < 0)
+        corrected[c] = -1;
+      else if(dirty[i] == 0)
+        corrected[c] = 0;
+      else
+        corrected[c] = decode_rs_8_syndromes(data[c], chunk_syndromes[i], NULL, 0, pads[c]);
+      if(corrected[c] >= 0)
+        decoded++;
+    }
+  }
+  return decoded;
+}
@@ -11,7 +11,7 @@
 #pragma GCC push_options
 #pragma GCC optimize ("O3")
 
-static enum {UNKNOWN=0,MMX,SSE,SSE2,ALTIVEC,PORT} cpu_mode;
+static enum {UNKNOWN=0,MMX,SSE,SSE2,ALTIVEC,PORT,SSSE3,AVX2,GFNI} cpu_mode;
 
 static void encode_rs_8_c(data_t *data, data_t *parity,int pad);
 #if __vec__
@@ -20,6 +20,13 @@ static void encode_rs_8_av(data_t *data, data_t *parity,int pad);
 #if __i386__
 int cpu_features(void);
 #endif
+#if __x86_64__
+/* rs_8_x86.c */
+int rs_8_x86_tier(void);
+void encode_rs_8_ssse3(data_t *data, data_t *parity,int pad);
+void encode_rs_8_avx2(data_t *data, data_t *parity,int pad);
+void encode_rs_8_gfni(data_t *data, data_t *parity,int pad);
+#endif
 
 void encode_rs_8(data_t *data, data_t *parity,int pad){
   if(cpu_mode == UNKNOWN){
@@ -36,6 +43,14 @@ void encode_rs_8(data_t *data, data_t *parity,int pad){
     } else { /* No SIMD at all */
       cpu_mode = PORT;
     }
+#elif __x86_64__
+    /* Every x86_64 has SSE2. Use the best SIMD encoder of the CPU. */
+    switch(rs_8_x86_tier()){
+    case 3: cpu_mode = GFNI; break;
+    case 2: cpu_mode = AVX2; break;
+    case 1: cpu_mode = SSSE3; break;
+    default: cpu_mode = PORT; break;
+    }
 #elif __VEC__
     /* Ask the OS if we have Altivec support */
     int selectors[2] = { CTL_HW, HW_VECTORUNIT };
@@ -56,6 +71,17 @@ void encode_rs_8(data_t *data, data_t *parity,int pad){
     encode_rs_8_av(data,parity,pad);
     return;
 #endif
+#if __x86_64__
+  case GFNI:
+    encode_rs_8_gfni(data,parity,pad);
+    return;
+  case AVX2:
+    encode_rs_8_avx2(data,parity,pad);
+    return;
+  case SSSE3:
+    encode_rs_8_ssse3(data,parity,pad);
+    return;
+#endif
 #if __i386__
   case MMX:
   case SSE:
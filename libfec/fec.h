@@ -251,6 +251,11 @@ void free_rs_int(void *rs);
  */
 void encode_rs_8(unsigned char *data,unsigned char *parity,int pad);
 int decode_rs_8(unsigned char *data,int *eras_pos,int no_eras,int pad);
+int decode_rs_8_syndromes(unsigned char *data,const unsigned char *syndromes,int *eras_pos,int no_eras,int pad);
+int syndromes_rs_8(const unsigned char *data,unsigned char *syndromes,int pad);
+/* Decode n codewords. syndromes (n*32 bytes from syndromes_rs_8) may be NULL. corrected[i]
+ * gets the result of each codeword as from decode_rs_8. Returns the number decoded successfully. */
+int decode_rs_8_batch(unsigned char **data,const int *pads,const unsigned char *syndromes,int *corrected,int n);
 
 /* CCSDS standard (255,223) RS codec with dual-basis symbol representation */
 void encode_rs_ccsds(unsigned char *data,unsigned char *parity,int pad);
@@ -0,0 +1,295 @@
+/* x86_64 SIMD versions of the CCSDS (255,223) Reed-Solomon encoder and syndrome computation
+ *
+ * The LFSR of the portable encoder processes one byte at a time and every
+ * step depends on the previous one. Since the code is linear, the parity is
+ * instead computed as the sum of data[i] * row[i + pad] where row[m] is the
+ * parity of a message having a single 1 at position m. Likewise the syndromes
+ * are the sum of data[j] * root^e over the 32 roots, where e is the degree of
+ * the byte in the codeword polynomial. The products don't depend on each other,
+ * so they are independent 32 byte vector operations:
+ *
+ * SSSE3: GF(256) multiply with two 16 entry nibble lookups (pshufb)
+ * AVX2:  same with the 32 bytes in a single register
+ * GFNI:  multiply by the data byte as an 8x8 bit matrix (gf2p8affineqb).
+ *        gf2p8mulb can't be used as it works in the AES field, not in the CCSDS field.
+ *
+ * The tables are generated from CCSDS_alpha_to, CCSDS_index_of and CCSDS_poly,
+ * so the results are identical to the portable encoder and decoder.
+ */
+#if defined(__x86_64__)
+
+#include <string.h>
+#include <pthread.h>
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "fixed.h"
+
+/* Parity of a message with a single 1 at each position, in the order of parity[] */
+static data_t parity_rows[NN-NROOTS][NROOTS] __attribute__((aligned(32)));
+
+/* Powers of the generator roots: syndrome_rows[e][i] = (alpha^((FCR+i)*PRIM))^e */
+static data_t syndrome_rows[NN][NROOTS] __attribute__((aligned(32)));
+
+/* Powers for the Chien search: chien_rows[j][i-1] = alpha^(j*i) for i = 1...256 */
+static data_t chien_rows[NROOTS+1][256] __attribute__((aligned(32)));
+
+/* Products of each byte with the low and high nibbles: mul_lo[d][x] = d*x, mul_hi[d][x] = d*(x<<4) */
+static data_t mul_lo[256][16] __attribute__((aligned(16)));
+static data_t mul_hi[256][16] __attribute__((aligned(16)));
+
+/* Multiplication by each byte as a bit matrix for gf2p8affineqb */
+static unsigned long long mul_matrix[256];
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+
+static data_t gf_mul(data_t a, data_t b){
+  if(a == 0 || b == 0)
+    return 0;
+  return ALPHA_TO[MODNN(INDEX_OF[a] + INDEX_OF[b])];
+}
+
+
+static void init_tables(void){
+  data_t coef[NROOTS];
+  int i, j, m;
+
+  /* LFSR feedback coefficients as in encode_rs.h */
+  for(j=0;j<NROOTS;j++)
+    coef[j] = ALPHA_TO[GENPOLY[NROOTS-1-j]];
+
+  /* Last message byte gives the feedback coefficients. Each earlier position is one more LFSR step. */
+  memcpy(parity_rows[NN-NROOTS-1], coef, NROOTS);
+  for(m=NN-NROOTS-2;m>=0;m--){
+    const data_t *next = parity_rows[m+1];
+    for(j=0;j<NROOTS;j++)
+      parity_rows[m][j] = (j < NROOTS-1 ? next[j+1] : 0) ^ gf_mul(next[0], coef[j]);
+  }
+
+  for(m=0;m<NN;m++)
+    for(j=0;j<NROOTS;j++)
+      syndrome_rows[m][j] = ALPHA_TO[((FCR+j)*PRIM*m) % NN];
+
+  for(j=0;j<=NROOTS;j++)
+    for(m=0;m<256;m++)
+      chien_rows[j][m] = ALPHA_TO[(j*(m+1)) % NN];
+
+  for(i=0;i<256;i++){
+    for(j=0;j<16;j++){
+      mul_lo[i][j] = gf_mul(i, j);
+      mul_hi[i][j] = gf_mul(i, j << 4);
+    }
+
+    /* Byte 7-b of the matrix selects the input bits giving the output bit b */
+    unsigned long long matrix = 0;
+    for(int b=0;b<8;b++){
+      data_t row = 0;
+      for(j=0;j<8;j++)
+        if(gf_mul(i, 1 << j) & (1 << b))
+          row |= 1 << j;
+      matrix |= (unsigned long long)row << (8 * (7 - b));
+    }
+    mul_matrix[i] = matrix;
+  }
+}
+
+
+/* Returns the best supported tier: 3 = GFNI, 2 = AVX2, 1 = SSSE3, 0 = none */
+int rs_8_x86_tier(void){
+  unsigned int eax, ebx, ecx, edx;
+  int gfni = 0;
+
+  __builtin_cpu_init();
+  if(__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    gfni = (ecx >> 8) & 1;
+
+  pthread_once(&tables_once, init_tables);
+
+  if(__builtin_cpu_supports("avx2") && gfni)
+    return 3;
+  if(__builtin_cpu_supports("avx2"))
+    return 2;
+  if(__builtin_cpu_supports("ssse3"))
+    return 1;
+  return 0;
+}
+
+
+__attribute__((target("ssse3")))
+void encode_rs_8_ssse3(data_t *data, data_t *parity, int pad){
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  __m128i p0 = _mm_setzero_si128(), p1 = _mm_setzero_si128();
+  int i;
+
+  for(i=0;i<NN-NROOTS-pad;i++){
+    const data_t d = data[i];
+    const __m128i lo = _mm_load_si128((const __m128i *)mul_lo[d]);
+    const __m128i hi = _mm_load_si128((const __m128i *)mul_hi[d]);
+    const __m128i r0 = _mm_load_si128((const __m128i *)&parity_rows[i+pad][0]);
+    const __m128i r1 = _mm_load_si128((const __m128i *)&parity_rows[i+pad][16]);
+
+    p0 = _mm_xor_si128(p0, _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(r0, nibble)),
+                                         _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(r0, 4), nibble))));
+    p1 = _mm_xor_si128(p1, _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(r1, nibble)),
+                                         _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(r1, 4), nibble))));
+  }
+  _mm_storeu_si128((__m128i *)&parity[0], p0);
+  _mm_storeu_si128((__m128i *)&parity[16], p1);
+}
+
+
+__attribute__((target("avx2")))
+void encode_rs_8_avx2(data_t *data, data_t *parity, int pad){
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  __m256i p = _mm256_setzero_si256();
+  int i;
+
+  for(i=0;i<NN-NROOTS-pad;i++){
+    const data_t d = data[i];
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)mul_lo[d]));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)mul_hi[d]));
+    const __m256i r = _mm256_load_si256((const __m256i *)parity_rows[i+pad]);
+
+    p = _mm256_xor_si256(p, _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(r, nibble)),
+                                             _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(r, 4), nibble))));
+  }
+  _mm256_storeu_si256((__m256i *)parity, p);
+}
+
+
+__attribute__((target("avx2,gfni")))
+void encode_rs_8_gfni(data_t *data, data_t *parity, int pad){
+  __m256i p = _mm256_setzero_si256();
+  int i;
+
+  for(i=0;i<NN-NROOTS-pad;i++){
+    const __m256i matrix = _mm256_set1_epi64x(mul_matrix[data[i]]);
+    const __m256i r = _mm256_load_si256((const __m256i *)parity_rows[i+pad]);
+    p = _mm256_xor_si256(p, _mm256_gf2p8affine_epi64_epi8(r, matrix, 0));
+  }
+  _mm256_storeu_si256((__m256i *)parity, p);
+}
+
+/* Syndromes of the codeword in polynomial form. Returns nonzero if any of them is nonzero. */
+__attribute__((target("ssse3")))
+int syndromes_rs_8_ssse3(const data_t *data, data_t *syndromes, int pad){
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  __m128i s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+  int j;
+
+  for(j=0;j<NN-pad;j++){
+    const data_t d = data[j];
+    const data_t *row = syndrome_rows[NN-pad-1-j];
+    const __m128i lo = _mm_load_si128((const __m128i *)mul_lo[d]);
+    const __m128i hi = _mm_load_si128((const __m128i *)mul_hi[d]);
+    const __m128i r0 = _mm_load_si128((const __m128i *)&row[0]);
+    const __m128i r1 = _mm_load_si128((const __m128i *)&row[16]);
+
+    s0 = _mm_xor_si128(s0, _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(r0, nibble)),
+                                         _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(r0, 4), nibble))));
+    s1 = _mm_xor_si128(s1, _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(r1, nibble)),
+                                         _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(r1, 4), nibble))));
+  }
+  _mm_storeu_si128((__m128i *)&syndromes[0], s0);
+  _mm_storeu_si128((__m128i *)&syndromes[16], s1);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(s0, s1), _mm_setzero_si128())) != 0xFFFF;
+}
+
+
+__attribute__((target("avx2")))
+int syndromes_rs_8_avx2(const data_t *data, data_t *syndromes, int pad){
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  __m256i s = _mm256_setzero_si256();
+  int j;
+
+  for(j=0;j<NN-pad;j++){
+    const data_t d = data[j];
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)mul_lo[d]));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)mul_hi[d]));
+    const __m256i r = _mm256_load_si256((const __m256i *)syndrome_rows[NN-pad-1-j]);
+
+    s = _mm256_xor_si256(s, _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(r, nibble)),
+                                             _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(r, 4), nibble))));
+  }
+  _mm256_storeu_si256((__m256i *)syndromes, s);
+  return !_mm256_testz_si256(s, s);
+}
+
+
+__attribute__((target("avx2,gfni")))
+int syndromes_rs_8_gfni(const data_t *data, data_t *syndromes, int pad){
+  __m256i s = _mm256_setzero_si256();
+  int j;
+
+  for(j=0;j<NN-pad;j++){
+    const __m256i matrix = _mm256_set1_epi64x(mul_matrix[data[j]]);
+    const __m256i r = _mm256_load_si256((const __m256i *)syndrome_rows[NN-pad-1-j]);
+    s = _mm256_xor_si256(s, _mm256_gf2p8affine_epi64_epi8(r, matrix, 0));
+  }
+  _mm256_storeu_si256((__m256i *)syndromes, s);
+  return !_mm256_testz_si256(s, s);
+}
+
+/* Store the roots of a block of the Chien search from the mask of zero evaluations */
+static inline int chien_roots(unsigned int mask, int block, int deg_lambda, data_t *root, data_t *loc, int count){
+  if(block == 7)
+    mask &= 0x7FFFFFFF; /* i = 256 is past the field */
+  while(mask){
+    const int i = 32 * block + __builtin_ctz(mask) + 1;
+    root[count] = i;
+    loc[count] = (i * IPRIM - 1) % NN;
+    if(++count == deg_lambda)
+      break;
+    mask &= mask - 1;
+  }
+  return count;
+}
+
+
+/*
+ * Chien search of decode_rs.h evaluating the error locator at 32 points at a time.
+ * lambda is in index form. Returns the number of roots found.
+ */
+__attribute__((target("avx2")))
+int chien_rs_8_avx2(const data_t *lambda, int deg_lambda, data_t *root, data_t *loc){
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  int block, j, count = 0;
+
+  for(block=0;block<8 && count<deg_lambda;block++){
+    __m256i q = _mm256_set1_epi8(1); /* lambda[0] is always 1 */
+    for(j=1;j<=deg_lambda;j++){
+      if(lambda[j] == NN) /* Zero in index form */
+        continue;
+      const data_t l = ALPHA_TO[lambda[j]];
+      const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)mul_lo[l]));
+      const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)mul_hi[l]));
+      const __m256i r = _mm256_load_si256((const __m256i *)&chien_rows[j][32 * block]);
+      q = _mm256_xor_si256(q, _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(r, nibble)),
+                                               _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(r, 4), nibble))));
+    }
+    count = chien_roots(_mm256_movemask_epi8(_mm256_cmpeq_epi8(q, _mm256_setzero_si256())), block, deg_lambda, root, loc, count);
+  }
+  return count;
+}
+
+
+__attribute__((target("avx2,gfni")))
+int chien_rs_8_gfni(const data_t *lambda, int deg_lambda, data_t *root, data_t *loc){
+  int block, j, count = 0;
+
+  for(block=0;block<8 && count<deg_lambda;block++){
+    __m256i q = _mm256_set1_epi8(1); /* lambda[0] is always 1 */
+    for(j=1;j<=deg_lambda;j++){
+      if(lambda[j] == NN) /* Zero in index form */
+        continue;
+      const __m256i matrix = _mm256_set1_epi64x(mul_matrix[ALPHA_TO[lambda[j]]]);
+      const __m256i r = _mm256_load_si256((const __m256i *)&chien_rows[j][32 * block]);
+      q = _mm256_xor_si256(q, _mm256_gf2p8affine_epi64_epi8(r, matrix, 0));
+    }
+    count = chien_roots(_mm256_movemask_epi8(_mm256_cmpeq_epi8(q, _mm256_setzero_si256())), block, deg_lambda, root, loc, count);
+  }
+  return count;
+}
+
+#endif
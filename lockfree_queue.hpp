@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue.
+ * Implementation follows Dmitry Vyukov's bounded MPMC queue: every cell carries
+ * a sequence number which tells whether the cell is ready to be written or read.
+ * The capacity is rounded up to the next power of two.
+ */
+template<typename T>
+class LockFreeQueue
+{
+public:
+
+	explicit LockFreeQueue(size_t capacity) :
+		enqueue_pos(0),
+		dequeue_pos(0)
+	{
+		size_t n = 2;
+		while (n < capacity)
+			n <<= 1;
+		mask = n - 1;
+
+		cells.reset(new Cell[n]);
+		for (size_t i = 0; i < n; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	LockFreeQueue(const LockFreeQueue &) = delete;
+	LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+
+	/* Push a new element to the queue. Returns false if the queue is full. */
+	bool push(const T &value) {
+		Cell *cell;
+		size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+		while (1) {
+			cell = &cells[pos & mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+				return false; // Full
+			else
+				pos = enqueue_pos.load(std::memory_order_relaxed);
+		}
+
+		cell->data = value;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Pop the oldest element from the queue. Returns false if the queue is empty. */
+	bool pop(T &value) {
+		Cell *cell;
+		size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+		while (1) {
+			cell = &cells[pos & mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+				return false; // Empty
+			else
+				pos = dequeue_pos.load(std::memory_order_relaxed);
+		}
+
+		value = cell->data;
+		cell->sequence.store(pos + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Number of elements in the queue. Only approximate when other threads are accessing the queue. */
+	size_t size() const {
+		size_t head = dequeue_pos.load(std::memory_order_relaxed);
+		size_t tail = enqueue_pos.load(std::memory_order_relaxed);
+		return (tail > head) ? (tail - head) : 0;
+	}
+
+	bool empty() const { return size() == 0; }
+
+	size_t capacity() const { return mask + 1; }
+
+private:
+
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+
+	/* Keep producer and consumer positions on separate cache lines */
+	alignas(64) std::atomic<size_t> enqueue_pos;
+	alignas(64) std::atomic<size_t> dequeue_pos;
+};
@@ -6,8 +6,7 @@
  * The pseudo random sequence generated using the polynomial  h(x) = x8 + x7 + x5 + x3 + 1.
  * Ref: CCSDS 131.0-B-3, 10.4.1
  */
-#define RANDOMIZER_LEN   256
-static const uint8_t randomizer[RANDOMIZER_LEN] = {
+const uint8_t csp_randomizer[RANDOMIZER_LEN] = {
 	0xff, 0x48, 0x0e, 0xc0, 0x9a, 0x0d, 0x70, 0xbc,
 	0x8e, 0x2c, 0x93, 0xad, 0xa7, 0xb7, 0x46, 0xce,
 	0x5a, 0x97, 0x7d, 0xcc, 0x32, 0xa2, 0xbf, 0x3e,
@@ -48,7 +47,7 @@ int csp_apply_rand(csp_packet_t* packet) {
 
 	uint8_t* data = (uint8_t*)&packet->id;
 	for (unsigned int i = 0; i < packet->length; i++)
-		data[i] ^= randomizer[i % RANDOMIZER_LEN];
+		data[i] ^= csp_randomizer[i & (RANDOMIZER_LEN - 1)];
 
 	return CSP_ERR_NONE;
 }
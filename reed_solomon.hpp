@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Parameters and tables of Reed-Solomon codes over GF(256), computed at compile time.
+ *
+ * The template parameters are the same as in libfec's init_rs_char():
+ *   GFPOLY  Field generator polynomial, e.g. 0x187 for CCSDS
+ *   FCR     First consecutive root of the code generator polynomial in index form
+ *   PRIM    Primitive element used to generate the roots
+ *   NROOTS  Number of parity symbols
+ *
+ * The radio links encode and decode with libfec. These give the code lengths to the
+ * adapters and let the code parameters and libfec's tables be checked at compile time.
+ */
+
+
+/* GF(256) and generator polynomial tables of a code */
+template<int GFPOLY, int FCR, int PRIM, int NROOTS>
+struct ReedSolomonTables {
+	constexpr ReedSolomonTables();
+
+	uint8_t alpha_to[256] = { };       // Index form to polynomial form. alpha_to[255] = 0
+	uint8_t index_of[256] = { };       // Polynomial form to index form. index_of[0] = 255 (zero)
+	uint8_t genpoly[NROOTS + 1] = { }; // Code generator polynomial in index form
+	int iprim = 0;                     // PRIM-th root of 1 used in the Chien search. 0 if none.
+	bool primitive = false;            // GFPOLY generates the whole field
+
+	static constexpr int modnn(int x) {
+		while (x >= 255) {
+			x -= 255;
+			x = (x >> 8) + (x & 255);
+		}
+		return x;
+	}
+};
+
+
+template<int GFPOLY, int FCR, int PRIM, int NROOTS>
+constexpr ReedSolomonTables<GFPOLY, FCR, PRIM, NROOTS>::ReedSolomonTables() {
+	// Field tables as in libfec's init_rs
+	index_of[0] = 255;
+	alpha_to[255] = 0;
+	int sr = 1;
+	for (int i = 0; i < 255; i++) {
+		index_of[sr] = i;
+		alpha_to[i] = sr;
+		sr <<= 1;
+		if (sr & 0x100)
+			sr ^= GFPOLY;
+		sr &= 0xFF;
+	}
+	primitive = (sr == 1);
+
+	for (int i = 1; i < 255 * PRIM; i += 255) {
+		if (i % PRIM == 0) {
+			iprim = i / PRIM;
+			break;
+		}
+	}
+
+	// Generator polynomial from its roots alpha^(PRIM*(FCR+i))
+	genpoly[0] = 1;
+	for (int i = 0, root = FCR * PRIM; i < NROOTS; i++, root += PRIM) {
+		genpoly[i + 1] = 1;
+		for (int j = i; j > 0; j--) {
+			if (genpoly[j] != 0)
+				genpoly[j] = genpoly[j - 1] ^ alpha_to[modnn(index_of[genpoly[j]] + root)];
+			else
+				genpoly[j] = genpoly[j - 1];
+		}
+		genpoly[0] = alpha_to[modnn(index_of[genpoly[0]] + root)];
+	}
+	for (int i = 0; i <= NROOTS; i++)
+		genpoly[i] = index_of[genpoly[i]];
+}
+
+
+/* Lengths and tables of a (255, 255 - NROOTS) code. Invalid parameters fail to compile. */
+template<int GFPOLY, int FCR, int PRIM, int NROOTS>
+struct ReedSolomonCode
+{
+	static constexpr int block_len = 255;
+	static constexpr int parity_len = NROOTS;
+	static constexpr int message_len = block_len - NROOTS;
+
+	static constexpr ReedSolomonTables<GFPOLY, FCR, PRIM, NROOTS> tables { };
+
+	static_assert(NROOTS > 0 && NROOTS < 255, "Invalid number of roots");
+	static_assert(FCR >= 0 && FCR < 255, "Invalid first consecutive root");
+	static_assert(GFPOLY >= 0x100 && GFPOLY < 0x200 && tables.primitive, "GFPOLY is not a primitive polynomial of degree 8");
+	static_assert(PRIM > 0 && PRIM < 255 && tables.iprim > 0, "PRIM has no inverse modulo 255");
+};
+
+
+/* CCSDS (255,223) code of libfec's encode_rs_8/decode_rs_8 */
+typedef ReedSolomonCode<0x187, 112, 11, 32> CCSDSReedSolomon;
+
+/* Code of the CSP radio links. The adapters use libfec's SIMD kernels for it. */
+typedef CCSDSReedSolomon CSPReedSolomon;
+#define CSP_RS_MSGLEN   CSPReedSolomon::message_len
+#define CSP_RS_PARITYS  CSPReedSolomon::parity_len
+
+static_assert(CCSDSReedSolomon::tables.iprim == 116 && CCSDSReedSolomon::tables.alpha_to[8] == 0x87 &&
+              CCSDSReedSolomon::tables.genpoly[1] == 249 && CCSDSReedSolomon::tables.genpoly[16] == 24,
+              "Tables differ from libfec's ccsds_tab.c");
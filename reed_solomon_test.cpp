@@ -0,0 +1,620 @@
+/*
+ * Conformance of the compile-time Reed-Solomon tables (reed_solomon.hpp) and libfec.
+ *
+ * The test has a scalar codec built on the tables. Its CCSDS instance is compared with
+ * encode_rs_8, syndromes_rs_8 and decode_rs_8 (with their SIMD kernels). A (255,239) code over the 0x11d field is compared with libfec's
+ * generic encode_rs.h and decode_rs.h compiled for the same parameters. Random codewords
+ * with random pads, errors and erasures, also beyond the correction capacity, must give
+ * the same parity, syndromes, corrected data, return values and error positions.
+ *
+ * libfec dispatches only to the best SIMD tier of the CPU, so on x86_64 the SSSE3, AVX2
+ * and GFNI kernels are also called directly and compared with the CCSDS instance,
+ * each tier the CPU supports.
+ *
+ * Build with -DBUILD_TESTS=ON and run ./reed_solomon_test [codewords]
+ */
+#include "reed_solomon.hpp"
+#include "libfec/fec.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+
+/*
+ * Scalar codec of a ReedSolomonCode, following libfec's encode_rs.h and decode_rs.h with
+ * the compile-time tables and constant loop bounds. Codewords can be shortened by `pad`
+ * symbols as in libfec.
+ */
+template<int GFPOLY, int FCR, int PRIM, int NROOTS>
+class ReedSolomon : public ReedSolomonCode<GFPOLY, FCR, PRIM, NROOTS>
+{
+public:
+	typedef ReedSolomonCode<GFPOLY, FCR, PRIM, NROOTS> Code;
+	using Code::block_len;
+	using Code::message_len;
+	using Code::tables;
+
+	/*
+	 * Compute the parity of message_len - pad bytes of data.
+	 * pad must be 0...message_len - 1.
+	 */
+	static void encode(const uint8_t *data, uint8_t *parity, int pad) {
+		for (int i = 0; i < NROOTS; i++)
+			parity[i] = 0;
+
+		for (int i = 0; i < message_len - pad; i++) {
+			const uint8_t feedback = tables.index_of[data[i] ^ parity[0]];
+			if (feedback != A0) {
+				for (int j = 1; j < NROOTS; j++)
+					parity[j] ^= tables.alpha_to[modnn(feedback + tables.genpoly[NROOTS - j])];
+			}
+			for (int j = 0; j < NROOTS - 1; j++)
+				parity[j] = parity[j + 1];
+			parity[NROOTS - 1] = (feedback != A0) ? tables.alpha_to[modnn(feedback + tables.genpoly[0])] : 0;
+		}
+	}
+
+	/*
+	 * Evaluate the syndromes of a codeword of block_len - pad bytes (in polynomial form).
+	 * Returns nonzero if any syndrome is nonzero, i.e. the codeword has errors.
+	 */
+	static int syndromes(const uint8_t *data, uint8_t *s, int pad) {
+		for (int i = 0; i < NROOTS; i++)
+			s[i] = data[0];
+
+		for (int j = 1; j < block_len - pad; j++) {
+			const uint8_t symbol = data[j];
+			for (int i = 0; i < NROOTS; i++) {
+				if (s[i] == 0)
+					s[i] = symbol;
+				else
+					s[i] = symbol ^ tables.alpha_to[modnn(tables.index_of[s[i]] + (FCR + i) * PRIM)];
+			}
+		}
+
+		int syn_error = 0;
+		for (int i = 0; i < NROOTS; i++)
+			syn_error |= s[i];
+		return syn_error;
+	}
+
+	/*
+	 * Correct a codeword of block_len - pad bytes in place.
+	 * Erasure positions are given in the full length block, i.e. pad included.
+	 * Returns the number of corrected symbols and stores their positions to eras_pos,
+	 * or -1 if the codeword can't be corrected.
+	 */
+	static int decode(uint8_t *data, int *eras_pos, int no_eras, int pad) {
+		if (pad < 0 || pad >= message_len || no_eras < 0 || no_eras > NROOTS)
+			return -1;
+
+		uint8_t s[NROOTS];
+		if (syndromes(data, s, pad) == 0)
+			return 0;
+
+		return correct(data, s, eras_pos, no_eras, pad);
+	}
+
+private:
+	static constexpr uint8_t A0 = 255;
+
+	static constexpr int modnn(int x) {
+		return ReedSolomonTables<GFPOLY, FCR, PRIM, NROOTS>::modnn(x);
+	}
+
+	/* Berlekamp-Massey, Chien search and Forney as in libfec's decode_rs.h. */
+	static int correct(uint8_t *data, uint8_t s[NROOTS], int *eras_pos, int no_eras, int pad) {
+		uint8_t lambda[NROOTS + 1], b[NROOTS + 1], t[NROOTS + 1], omega[NROOTS + 1];
+		uint8_t reg[NROOTS + 1], root[NROOTS], loc[NROOTS];
+		int count = 0;
+
+		// Syndromes to index form
+		for (int i = 0; i < NROOTS; i++)
+			s[i] = tables.index_of[s[i]];
+
+		for (int i = 1; i <= NROOTS; i++)
+			lambda[i] = 0;
+		lambda[0] = 1;
+
+		if (no_eras > 0) {
+			// Init lambda to be the erasure locator polynomial
+			lambda[1] = tables.alpha_to[modnn(PRIM * (block_len - 1 - eras_pos[0]))];
+			for (int i = 1; i < no_eras; i++) {
+				const uint8_t u = modnn(PRIM * (block_len - 1 - eras_pos[i]));
+				for (int j = i + 1; j > 0; j--) {
+					const uint8_t tmp = tables.index_of[lambda[j - 1]];
+					if (tmp != A0)
+						lambda[j] ^= tables.alpha_to[modnn(u + tmp)];
+				}
+			}
+		}
+		for (int i = 0; i <= NROOTS; i++)
+			b[i] = tables.index_of[lambda[i]];
+
+		// Berlekamp-Massey algorithm to determine the error and erasure locator polynomial
+		int el = no_eras;
+		for (int r = no_eras + 1; r <= NROOTS; r++) {
+			// Discrepancy at the r-th step in polynomial form
+			uint8_t discr_r = 0;
+			for (int i = 0; i < r; i++) {
+				if (lambda[i] != 0 && s[r - i - 1] != A0)
+					discr_r ^= tables.alpha_to[modnn(tables.index_of[lambda[i]] + s[r - i - 1])];
+			}
+			discr_r = tables.index_of[discr_r];
+
+			if (discr_r == A0) {
+				// B(x) <-- x*B(x)
+				for (int i = NROOTS; i > 0; i--)
+					b[i] = b[i - 1];
+				b[0] = A0;
+				continue;
+			}
+
+			// T(x) <-- lambda(x) - discr_r*x*b(x)
+			t[0] = lambda[0];
+			for (int i = 0; i < NROOTS; i++) {
+				if (b[i] != A0)
+					t[i + 1] = lambda[i + 1] ^ tables.alpha_to[modnn(discr_r + b[i])];
+				else
+					t[i + 1] = lambda[i + 1];
+			}
+			if (2 * el <= r + no_eras - 1) {
+				el = r + no_eras - el;
+				// B(x) <-- inv(discr_r) * lambda(x)
+				for (int i = 0; i <= NROOTS; i++)
+					b[i] = (lambda[i] == 0) ? A0 : modnn(tables.index_of[lambda[i]] - discr_r + block_len);
+			}
+			else {
+				// B(x) <-- x*B(x)
+				for (int i = NROOTS; i > 0; i--)
+					b[i] = b[i - 1];
+				b[0] = A0;
+			}
+			for (int i = 0; i <= NROOTS; i++)
+				lambda[i] = t[i];
+		}
+
+		// Lambda to index form and its degree
+		int deg_lambda = 0;
+		for (int i = 0; i <= NROOTS; i++) {
+			lambda[i] = tables.index_of[lambda[i]];
+			if (lambda[i] != A0)
+				deg_lambda = i;
+		}
+
+		// Roots of the error and erasure locator polynomial by Chien search
+		for (int i = 1; i <= NROOTS; i++)
+			reg[i] = lambda[i];
+		for (int i = 1, k = tables.iprim - 1; i <= block_len; i++, k = modnn(k + tables.iprim)) {
+			uint8_t q = 1; // lambda[0] is always 0
+			for (int j = deg_lambda; j > 0; j--) {
+				if (reg[j] != A0) {
+					reg[j] = modnn(reg[j] + j);
+					q ^= tables.alpha_to[reg[j]];
+				}
+			}
+			if (q != 0)
+				continue;
+			root[count] = i;
+			loc[count] = k;
+			if (++count == deg_lambda)
+				break;
+		}
+		if (deg_lambda != count)
+			return -1; // Uncorrectable
+
+		// Error and erasure evaluator polynomial omega(x) = s(x)*lambda(x) (mod x^NROOTS) in index form
+		const int deg_omega = deg_lambda - 1;
+		for (int i = 0; i <= deg_omega; i++) {
+			uint8_t tmp = 0;
+			for (int j = i; j >= 0; j--) {
+				if (s[i - j] != A0 && lambda[j] != A0)
+					tmp ^= tables.alpha_to[modnn(s[i - j] + lambda[j])];
+			}
+			omega[i] = tables.index_of[tmp];
+		}
+
+		// Error values by Forney: omega(inv(X(l))) * inv(X(l))^(FCR-1) / lambda_pr(inv(X(l)))
+		for (int j = count - 1; j >= 0; j--) {
+			uint8_t num1 = 0;
+			for (int i = deg_omega; i >= 0; i--) {
+				if (omega[i] != A0)
+					num1 ^= tables.alpha_to[modnn(omega[i] + i * root[j])];
+			}
+			const uint8_t num2 = tables.alpha_to[modnn(root[j] * (FCR - 1) + block_len)];
+
+			// lambda[i+1] for i even is the formal derivative of lambda
+			uint8_t den = 0;
+			for (int i = ((deg_lambda < NROOTS - 1) ? deg_lambda : NROOTS - 1) & ~1; i >= 0; i -= 2) {
+				if (lambda[i + 1] != A0)
+					den ^= tables.alpha_to[modnn(lambda[i + 1] + i * root[j])];
+			}
+
+			if (num1 != 0 && loc[j] >= pad)
+				data[loc[j] - pad] ^= tables.alpha_to[modnn(tables.index_of[num1] + tables.index_of[num2] + block_len - tables.index_of[den])];
+		}
+
+		if (eras_pos != nullptr) {
+			for (int i = 0; i < count; i++)
+				eras_pos[i] = loc[i];
+		}
+		return count;
+	}
+};
+
+
+/* CCSDS (255,223) code of libfec's encode_rs_8/decode_rs_8 */
+typedef ReedSolomon<0x187, 112, 11, 32> CCSDSCodec;
+
+
+/* Non-CCSDS code: (255,239) over the field 0x11d as in DVB */
+#define REF_GFPOLY  0x11d
+#define REF_FCR     0
+#define REF_PRIM    1
+#define REF_NROOTS  16
+
+typedef ReedSolomon<REF_GFPOLY, REF_FCR, REF_PRIM, REF_NROOTS> ReferenceReedSolomon;
+
+
+/* Tables of the generic libfec codec computed as in libfec's init_rs_char */
+static uint8_t ref_alpha_to[256], ref_index_of[256], ref_genpoly[REF_NROOTS + 1];
+static int ref_iprim;
+
+static int ref_modnn(int x) {
+	while (x >= 255) {
+		x -= 255;
+		x = (x >> 8) + (x & 255);
+	}
+	return x;
+}
+
+static void ref_init() {
+	ref_index_of[0] = 255;
+	ref_alpha_to[255] = 0;
+	int sr = 1;
+	for (int i = 0; i < 255; i++) {
+		ref_index_of[sr] = i;
+		ref_alpha_to[i] = sr;
+		sr <<= 1;
+		if (sr & 0x100)
+			sr ^= REF_GFPOLY;
+		sr &= 0xFF;
+	}
+
+	for (ref_iprim = 1; ref_iprim % REF_PRIM != 0; ref_iprim += 255);
+	ref_iprim /= REF_PRIM;
+
+	ref_genpoly[0] = 1;
+	for (int i = 0, root = REF_FCR * REF_PRIM; i < REF_NROOTS; i++, root += REF_PRIM) {
+		ref_genpoly[i + 1] = 1;
+		for (int j = i; j > 0; j--) {
+			if (ref_genpoly[j] != 0)
+				ref_genpoly[j] = ref_genpoly[j - 1] ^ ref_alpha_to[ref_modnn(ref_index_of[ref_genpoly[j]] + root)];
+			else
+				ref_genpoly[j] = ref_genpoly[j - 1];
+		}
+		ref_genpoly[0] = ref_alpha_to[ref_modnn(ref_index_of[ref_genpoly[0]] + root)];
+	}
+	for (int i = 0; i <= REF_NROOTS; i++)
+		ref_genpoly[i] = ref_index_of[ref_genpoly[i]];
+}
+
+
+/* libfec's generic codec for the reference code */
+typedef unsigned char data_t;
+#define MODNN(x)  ref_modnn(x)
+#define NN        255
+#define ALPHA_TO  ref_alpha_to
+#define INDEX_OF  ref_index_of
+#define GENPOLY   ref_genpoly
+#define NROOTS    REF_NROOTS
+#define FCR       REF_FCR
+#define PRIM      REF_PRIM
+#define IPRIM     ref_iprim
+#define PAD       pad
+
+static void ref_encode(data_t *data, data_t *parity, int pad) {
+#include "libfec/encode_rs.h"
+}
+
+static int ref_decode(data_t *data, int *eras_pos, int no_eras, int pad) {
+	int retval;
+#include "libfec/decode_rs.h"
+	return retval;
+}
+
+/* Syndromes as decode_rs.h evaluates them */
+static int ref_syndromes(const data_t *data, data_t *s, int pad) {
+	for (int i = 0; i < NROOTS; i++)
+		s[i] = data[0];
+	for (int j = 1; j < NN - pad; j++) {
+		for (int i = 0; i < NROOTS; i++)
+			s[i] = (s[i] == 0) ? data[j] : (data[j] ^ ALPHA_TO[MODNN(INDEX_OF[s[i]] + (FCR + i) * PRIM)]);
+	}
+	int syn_error = 0;
+	for (int i = 0; i < NROOTS; i++)
+		syn_error |= s[i];
+	return syn_error != 0;
+}
+
+#undef MODNN
+#undef NN
+#undef ALPHA_TO
+#undef INDEX_OF
+#undef GENPOLY
+#undef NROOTS
+#undef FCR
+#undef PRIM
+#undef IPRIM
+#undef PAD
+
+
+/* Reference implementation of a code for the comparison */
+struct Reference {
+	void (*encode)(data_t *data, data_t *parity, int pad);
+	int (*syndromes)(const data_t *data, data_t *s, int pad);
+	int (*decode)(data_t *data, int *eras_pos, int no_eras, int pad);
+};
+
+
+/*
+ * Compare the codec with the reference on random codewords. Returns the number of mismatches.
+ * Every codeword has up to parity_len / 2 + 4 errors and up to parity_len erasures, so
+ * also decoding failures and wrong decodings are compared.
+ */
+template<typename Codec>
+static unsigned int compare(const char *name, const Reference &ref, size_t count, mt19937 &rng) {
+	const int n = Codec::block_len, k = Codec::message_len, nroots = Codec::parity_len;
+	unsigned int mismatches = 0, corrected = 0, failed = 0;
+
+	for (size_t c = 0; c < count; c++) {
+		const int pad = rng() % k;
+		const int len = n - pad;
+
+		// Encode
+		uint8_t codeword[255], parity[255];
+		for (int i = 0; i < len - nroots; i++)
+			codeword[i] = rng();
+		Codec::encode(codeword, parity, pad);
+		ref.encode(codeword, &codeword[len - nroots], pad);
+		if (memcmp(parity, &codeword[len - nroots], nroots) != 0) {
+			printf("%s: Parity differs, pad %d\n", name, pad);
+			mismatches++;
+			continue;
+		}
+
+		// Erasures at distinct positions of the full length block, some of them corrupted
+		int eras_pos[255], ref_eras_pos[255];
+		const int no_eras = (rng() % 3 == 0) ? rng() % (nroots + 1) : 0;
+		vector<int> positions(len);
+		for (int i = 0; i < len; i++)
+			positions[i] = i;
+		shuffle(positions.begin(), positions.end(), rng);
+		for (int i = 0; i < no_eras; i++) {
+			eras_pos[i] = positions[i] + pad;
+			if (rng() % 2)
+				codeword[positions[i]] ^= 1 + rng() % 255;
+		}
+
+		// Errors anywhere in the codeword
+		const int errors = rng() % (nroots / 2 + 5);
+		for (int e = 0; e < errors; e++)
+			codeword[rng() % len] ^= 1 + rng() % 255;
+
+		// Syndromes
+		uint8_t s[255], ref_s[255];
+		const bool error = Codec::syndromes(codeword, s, pad) != 0;
+		const bool ref_error = ref.syndromes(codeword, ref_s, pad) != 0;
+		if (error != ref_error || memcmp(s, ref_s, nroots) != 0) {
+			printf("%s: Syndromes differ, pad %d\n", name, pad);
+			mismatches++;
+			continue;
+		}
+
+		// Decode
+		uint8_t data[255], ref_data[255];
+		memcpy(data, codeword, len);
+		memcpy(ref_data, codeword, len);
+		memcpy(ref_eras_pos, eras_pos, sizeof(eras_pos));
+		const int ret = Codec::decode(data, eras_pos, no_eras, pad);
+		const int ref_ret = ref.decode(ref_data, ref_eras_pos, no_eras, pad);
+		if (ret != ref_ret || memcmp(data, ref_data, len) != 0 ||
+		    (ret > 0 && memcmp(eras_pos, ref_eras_pos, ret * sizeof(int)) != 0)) {
+			printf("%s: Decoding differs, pad %d, %d errors, %d erasures: returned %d, expected %d\n",
+			       name, pad, errors, no_eras, ret, ref_ret);
+			mismatches++;
+			continue;
+		}
+
+		if (ret < 0)
+			failed++;
+		else
+			corrected++;
+	}
+
+	printf("%-10s %8zu codewords: %8u decoded, %8u failed, %u mismatches\n", name, count, corrected, failed, mismatches);
+	return mismatches;
+}
+
+
+#if __x86_64__
+
+/* SIMD kernels of libfec/rs_8_x86.c */
+extern "C" {
+int rs_8_x86_tier(void);
+void encode_rs_8_ssse3(data_t *data, data_t *parity, int pad);
+void encode_rs_8_avx2(data_t *data, data_t *parity, int pad);
+void encode_rs_8_gfni(data_t *data, data_t *parity, int pad);
+int syndromes_rs_8_ssse3(const data_t *data, data_t *syndromes, int pad);
+int syndromes_rs_8_avx2(const data_t *data, data_t *syndromes, int pad);
+int syndromes_rs_8_gfni(const data_t *data, data_t *syndromes, int pad);
+int chien_rs_8_avx2(const data_t *lambda, int deg_lambda, data_t *root, data_t *loc);
+int chien_rs_8_gfni(const data_t *lambda, int deg_lambda, data_t *root, data_t *loc);
+}
+
+struct Tier {
+	const char *name;
+	int level;  // rs_8_x86_tier() needed
+	void (*encode)(data_t *data, data_t *parity, int pad);
+	int (*syndromes)(const data_t *data, data_t *syndromes, int pad);
+	int (*chien)(const data_t *lambda, int deg_lambda, data_t *root, data_t *loc);  // NULL = scalar
+};
+
+
+/* Scalar Chien search of decode_rs.h for the CCSDS code. lambda is in index form. */
+static int ref_chien(const data_t *lambda, int deg_lambda, data_t *root, data_t *loc) {
+	constexpr auto &t = CCSDSCodec::tables;
+	const int nroots = CCSDSCodec::parity_len;
+	data_t reg[nroots + 1];
+	memcpy(&reg[1], &lambda[1], nroots);
+
+	int count = 0;
+	for (int i = 1, k = t.iprim - 1; i <= 255; i++, k = t.modnn(k + t.iprim)) {
+		data_t q = 1;
+		for (int j = deg_lambda; j > 0; j--) {
+			if (reg[j] != 255) {
+				reg[j] = t.modnn(reg[j] + j);
+				q ^= t.alpha_to[reg[j]];
+			}
+		}
+		if (q != 0)
+			continue;
+		root[count] = i;
+		loc[count] = k;
+		if (++count == deg_lambda)
+			break;
+	}
+	return count;
+}
+
+
+/*
+ * Compare every SIMD tier supported by the CPU with the CCSDS instance on random codewords
+ * and error locators. Returns the number of mismatches.
+ */
+static unsigned int compare_tiers(size_t count, mt19937 &rng) {
+	typedef CCSDSCodec Codec;
+	constexpr auto &t = Codec::tables;
+	const int n = Codec::block_len, k = Codec::message_len, nroots = Codec::parity_len;
+
+	const Tier tiers[] = {
+		{ "SSSE3", 1, encode_rs_8_ssse3, syndromes_rs_8_ssse3, NULL },
+		{ "AVX2", 2, encode_rs_8_avx2, syndromes_rs_8_avx2, chien_rs_8_avx2 },
+		{ "GFNI", 3, encode_rs_8_gfni, syndromes_rs_8_gfni, chien_rs_8_gfni },
+	};
+	const int supported = rs_8_x86_tier(); // Also initializes the kernels' tables
+
+	unsigned int mismatches = 0;
+	for (const Tier &tier: tiers) {
+		if (tier.level > supported) {
+			printf("%-10s not supported by the CPU, skipped\n", tier.name);
+			continue;
+		}
+
+		unsigned int tier_mismatches = 0;
+		for (size_t c = 0; c < count; c++) {
+			const int pad = rng() % k;
+			const int len = n - pad;
+
+			// Encode
+			uint8_t codeword[255], parity[255];
+			for (int i = 0; i < len - nroots; i++)
+				codeword[i] = rng();
+			Codec::encode(codeword, parity, pad);
+			tier.encode(codeword, &codeword[len - nroots], pad);
+			if (memcmp(parity, &codeword[len - nroots], nroots) != 0) {
+				printf("%s: Parity differs, pad %d\n", tier.name, pad);
+				tier_mismatches++;
+				continue;
+			}
+
+			// Syndromes of the codeword with random errors
+			const int errors = rng() % (nroots / 2 + 5);
+			for (int e = 0; e < errors; e++)
+				codeword[rng() % len] ^= 1 + rng() % 255;
+
+			uint8_t s[255], tier_s[255];
+			const bool error = Codec::syndromes(codeword, s, pad) != 0;
+			const bool tier_error = tier.syndromes(codeword, tier_s, pad) != 0;
+			if (error != tier_error || memcmp(s, tier_s, nroots) != 0) {
+				printf("%s: Syndromes differ, pad %d, %d errors\n", tier.name, pad, errors);
+				tier_mismatches++;
+				continue;
+			}
+
+			if (tier.chien == NULL)
+				continue;
+
+			/*
+			 * Chien search. Half of the error locators are products of distinct
+			 * (1 + X x) factors and have all their roots in the field.
+			 */
+			const int deg = 1 + rng() % (nroots / 2);
+			uint8_t lambda[nroots + 1] = { 1 };
+			if (rng() % 2) {
+				vector<int> locators(255);
+				for (int i = 0; i < 255; i++)
+					locators[i] = i;
+				shuffle(locators.begin(), locators.end(), rng);
+				for (int d = 0; d < deg; d++) {
+					// lambda *= 1 + alpha^locator x
+					for (int j = d + 1; j > 0; j--) {
+						if (lambda[j - 1] != 0)
+							lambda[j] ^= t.alpha_to[t.modnn(t.index_of[lambda[j - 1]] + locators[d])];
+					}
+				}
+			}
+			else {
+				for (int j = 1; j <= deg; j++)
+					lambda[j] = rng();
+				lambda[deg] |= 1;
+			}
+			for (int j = 0; j <= nroots; j++)
+				lambda[j] = t.index_of[lambda[j]];
+
+			uint8_t root[nroots], loc[nroots], tier_root[nroots], tier_loc[nroots];
+			const int roots = ref_chien(lambda, deg, root, loc);
+			const int tier_roots = tier.chien(lambda, deg, tier_root, tier_loc);
+			if (roots != tier_roots || memcmp(root, tier_root, roots) != 0 || memcmp(loc, tier_loc, roots) != 0) {
+				printf("%s: Chien search differs, degree %d: %d roots, expected %d\n", tier.name, deg, tier_roots, roots);
+				tier_mismatches++;
+			}
+		}
+
+		printf("%-10s %8zu codewords: %u mismatches\n", tier.name, count, tier_mismatches);
+		mismatches += tier_mismatches;
+	}
+	return mismatches;
+}
+
+#endif
+
+
+int main(int argc, char *argv[]) {
+
+	const size_t count = (argc > 1) ? atoi(argv[1]) : 20000;
+	mt19937 rng(1);
+	ref_init();
+
+	const Reference ccsds = {
+		[](data_t *data, data_t *parity, int pad) { encode_rs_8(data, parity, pad); },
+		[](const data_t *data, data_t *s, int pad) { return syndromes_rs_8(data, s, pad); },
+		decode_rs_8,
+	};
+	const Reference generic = { ref_encode, ref_syndromes, ref_decode };
+
+	unsigned int mismatches = 0;
+	mismatches += compare<CCSDSCodec>("CCSDS", ccsds, count, rng);
+	mismatches += compare<ReferenceReedSolomon>("(255,239)", generic, count, rng);
+#if __x86_64__
+	mismatches += compare_tiers(count, rng);
+#endif
+
+	return (mismatches == 0) ? 0 : 1;
+}
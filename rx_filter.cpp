@@ -0,0 +1,89 @@
+#include "rx_filter.hpp"
+
+#include <suo.hpp>
+#include <string.h>
+
+using namespace std;
+
+
+RxFilterRule::RxFilterRule(const string &_name, bool _accept) :
+	name(_name),
+	accept(_accept),
+	src((uint32_t)RX_FILTER_ANY),
+	dst((uint32_t)RX_FILTER_ANY),
+	dport(RX_FILTER_ANY),
+	sport(RX_FILTER_ANY),
+	flags_mask(0),
+	flags_value(0)
+{
+}
+
+
+uint64_t RxFilterRule::range(unsigned int first, unsigned int last) {
+	uint64_t bitmap = 0;
+	for (unsigned int value = first; value <= last && value < 64; value++)
+		bitmap |= (uint64_t)1 << value;
+	return bitmap;
+}
+
+
+RxFilter::RxFilter(const vector<RxFilterRule> &_rules, bool _default_accept) :
+	rules(_rules),
+	default_accept(_default_accept),
+	accept_mask(0)
+{
+	if (rules.size() > RX_FILTER_MAX_RULES)
+		throw suo::SuoError("RxFilter: Too many rules (%u)", (unsigned int)rules.size());
+
+	memset(src_table, 0, sizeof(src_table));
+	memset(dst_table, 0, sizeof(dst_table));
+	memset(dport_table, 0, sizeof(dport_table));
+	memset(sport_table, 0, sizeof(sport_table));
+	memset(flags_table, 0, sizeof(flags_table));
+
+	/* Compile: Set the rule's bit for every field value the rule accepts */
+	for (unsigned int i = 0; i < rules.size(); i++) {
+		const RxFilterRule &rule = rules[i];
+		const uint64_t bit = (uint64_t)1 << i;
+
+		if (rule.accept)
+			accept_mask |= bit;
+
+		for (unsigned int value = 0; value < 32; value++) {
+			if (rule.src & (1u << value))
+				src_table[value] |= bit;
+			if (rule.dst & (1u << value))
+				dst_table[value] |= bit;
+		}
+		for (unsigned int value = 0; value < 64; value++) {
+			if (rule.dport & ((uint64_t)1 << value))
+				dport_table[value] |= bit;
+			if (rule.sport & ((uint64_t)1 << value))
+				sport_table[value] |= bit;
+		}
+		for (unsigned int value = 0; value < 256; value++) {
+			if ((value & rule.flags_mask) == rule.flags_value)
+				flags_table[value] |= bit;
+		}
+	}
+
+	hits.reset(new atomic<unsigned int>[rules.size() + 1]);
+	for (unsigned int i = 0; i <= rules.size(); i++)
+		hits[i] = 0;
+}
+
+
+bool RxFilter::match(csp_id_t id, int &rule) {
+	const uint64_t matching = src_table[id.src] & dst_table[id.dst] &
+	                          dport_table[id.dport] & sport_table[id.sport] & flags_table[id.flags];
+	if (matching == 0) {
+		rule = -1;
+		hits[rules.size()]++;
+		return default_accept;
+	}
+
+	// Lowest bit is the first rule in the table
+	rule = __builtin_ctzll(matching);
+	hits[rule]++;
+	return (accept_mask >> rule) & 1;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <csp/csp.h>
+
+/* Maximum number of rules in a filter */
+#define RX_FILTER_MAX_RULES  64
+
+/* Bitmap matching every value of a header field */
+#define RX_FILTER_ANY  (~(uint64_t)0)
+
+
+/*
+ * Rule of the received packet filter. A packet matches the rule if each of its
+ * header fields has its bit set in the corresponding bitmap and
+ * (flags & flags_mask) == flags_value.
+ */
+struct RxFilterRule {
+	RxFilterRule(const std::string &name = "", bool accept = true);
+
+	std::string name;
+	bool accept;           // Action for the matching packets: Accept or drop
+
+	uint32_t src;          // Bitmap of source addresses (0-31)
+	uint32_t dst;          // Bitmap of destination addresses (0-31)
+	uint64_t dport;        // Bitmap of destination ports (0-63)
+	uint64_t sport;        // Bitmap of source ports (0-63)
+	uint8_t flags_mask;
+	uint8_t flags_value;
+
+	/* Bitmap of values first...last (inclusive) */
+	static uint64_t range(unsigned int first, unsigned int last);
+};
+
+
+/*
+ * Received packet filter. The rule table is compiled into a lookup table per
+ * header field holding a bitmask of the rules accepting the field value, so
+ * matching a packet costs five table lookups regardless of the number of rules.
+ * The first matching rule decides. Thread safe after construction.
+ */
+class RxFilter
+{
+public:
+	/*
+	 * rules: Rule table in the order of precedence (max RX_FILTER_MAX_RULES)
+	 * default_accept: Action if no rule matches
+	 */
+	RxFilter(const std::vector<RxFilterRule> &rules, bool default_accept);
+
+	RxFilter(const RxFilter &) = delete;
+	RxFilter &operator=(const RxFilter &) = delete;
+
+	/*
+	 * Match a CSP header (host byte order).
+	 * Returns true if the packet is accepted. `rule` is set to the index of the matching rule or -1.
+	 */
+	bool match(csp_id_t id, int &rule);
+
+	/* Number of packets matched by a rule. Index rules.size() counts the packets matching no rule. */
+	unsigned int getHits(unsigned int rule) const { return hits[rule]; }
+
+	const std::vector<RxFilterRule> &getRules() const { return rules; }
+
+private:
+	std::vector<RxFilterRule> rules;
+	bool default_accept;
+	uint64_t accept_mask;      // Rules with the accept action
+
+	uint64_t src_table[32];
+	uint64_t dst_table[32];
+	uint64_t dport_table[64];
+	uint64_t sport_table[64];
+	uint64_t flags_table[256];
+
+	std::unique_ptr<std::atomic<unsigned int>[]> hits;
+};
@@ -0,0 +1,57 @@
+#include "rx_kernel.hpp"
+#include "csp_modem.hpp"
+#include "libfec/fec.h"
+
+#include <algorithm>
+#include <string.h>
+
+
+/* Lookup tables of the kernel */
+struct RxKernelTables {
+	RxKernelTables();
+
+	uint32_t crc32[256];
+	uint8_t no_randomizer[RANDOMIZER_LEN];
+};
+
+RxKernelTables::RxKernelTables() {
+	// Reflected Castagnoli polynomial as in csp_crc32.c
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (unsigned int bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? ((crc >> 1) ^ 0x82F63B78) : (crc >> 1);
+		crc32[i] = crc;
+	}
+
+	memset(no_randomizer, 0, sizeof(no_randomizer));
+}
+
+static const RxKernelTables tables;
+
+
+void rx_kernel(uint8_t *frame, size_t len, bool derandomize, bool syndromes, size_t crc_len, RxKernelResult &result) {
+
+	const uint8_t *sequence = derandomize ? csp_randomizer : tables.no_randomizer;
+	crc_len = std::min(crc_len, len);
+
+	uint32_t crc = 0xFFFFFFFF;
+	size_t j = 0;
+	for (; j < crc_len; j++) {
+		const uint8_t byte = frame[j] ^ sequence[j & (RANDOMIZER_LEN - 1)];
+		crc = tables.crc32[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+		frame[j] = byte;
+	}
+	if (derandomize) {
+		for (; j < len; j++)
+			frame[j] ^= sequence[j & (RANDOMIZER_LEN - 1)];
+	}
+	result.crc = crc ^ 0xFFFFFFFF;
+
+	// Syndromes with the SIMD kernel of libfec while the frame is still in the cache. Shortened code is padded to 255 bytes.
+	if (syndromes)
+		result.syndrome_error = (syndromes_rs_8(frame, result.syndromes, 255 - len) != 0);
+	else {
+		result.syndrome_error = false;
+		memset(result.syndromes, 0, sizeof(result.syndromes));
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of Reed-Solomon parity symbols of the CCSDS (255,223) code */
+#define RX_KERNEL_NROOTS  32
+
+
+struct RxKernelResult {
+	bool syndrome_error;                  // Some syndrome is nonzero, i.e. the codeword has errors
+	uint8_t syndromes[RX_KERNEL_NROOTS];  // In polynomial form for decode_rs_8_syndromes
+	uint32_t crc;                         // CRC32 (Castagnoli) of the first crc_len bytes
+};
+
+
+/*
+ * Pre-processing of a received frame while it is in the cache:
+ * - derandomizes the frame in place and computes the CRC32 of the first `crc_len`
+ *   bytes (as csp_crc32_memory does) in a single pass
+ * - computes the syndromes of the CCSDS Reed-Solomon codeword with the SIMD kernel of libfec
+ *
+ * When all the syndromes are zero the codeword is valid and the RS decoder can be skipped.
+ * The CRC is only usable if the RS decoder didn't modify the bytes.
+ */
+void rx_kernel(uint8_t *frame, size_t len, bool derandomize, bool syndromes, size_t crc_len, RxKernelResult &result);
@@ -0,0 +1,130 @@
+/*
+ * Per frame cost of the RX pre-processing: derandomization, Reed-Solomon decoding and CRC32.
+ *
+ * "separate" is the original path walking the frame once per stage: the derandomization
+ * loop of csp_apply_rand, the scalar syndrome loop of libfec's decode_rs.h followed by the
+ * rest of the decoder (decode_rs_8_syndromes), and the bytewise CRC. decode_rs_8 itself
+ * can't be used for it as it now has the SIMD syndromes. "fused" is the single pass
+ * rx_kernel which skips the RS decoder when all the syndromes are zero. Both use the same
+ * Berlekamp-Massey and Chien search when there are errors.
+ *
+ * Build with -DBUILD_BENCHMARKS=ON and run ./rx_kernel_benchmark [frames]
+ */
+#include "csp_modem.hpp"
+#include "rx_kernel.hpp"
+#include "libfec/fec.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string.h>
+
+using namespace std;
+
+
+#define FRAME_LEN  255
+#define CRC_LEN    (FRAME_LEN - RX_KERNEL_NROOTS - 4)
+
+
+/* Reference bytewise CRC32 (Castagnoli) as in csp_crc32.c */
+static uint32_t crc32_reference(const uint8_t *data, size_t len) {
+	static uint32_t table[256];
+	if (table[1] == 0) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t crc = i;
+			for (unsigned int bit = 0; bit < 8; bit++)
+				crc = (crc & 1) ? ((crc >> 1) ^ 0x82F63B78) : (crc >> 1);
+			table[i] = crc;
+		}
+	}
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < len; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFF;
+}
+
+
+/* libfec's CCSDS field tables (ccsds_tab.c) */
+extern "C" const unsigned char CCSDS_alpha_to[], CCSDS_index_of[];
+
+/* Syndromes in polynomial form as decode_rs.h computes them without the SIMD kernels */
+static void syndromes_scalar(const uint8_t *data, uint8_t *s) {
+	for (int i = 0; i < RX_KERNEL_NROOTS; i++)
+		s[i] = data[0];
+
+	for (int j = 1; j < FRAME_LEN; j++) {
+		for (int i = 0; i < RX_KERNEL_NROOTS; i++) {
+			if (s[i] == 0)
+				s[i] = data[j];
+			else
+				s[i] = data[j] ^ CCSDS_alpha_to[(CCSDS_index_of[s[i]] + (112 + i) * 11) % 255];
+		}
+	}
+}
+
+
+/* Randomized codewords with `errors` corrupted bytes each */
+static vector<vector<uint8_t>> make_frames(size_t count, unsigned int errors, mt19937 &rng) {
+	vector<vector<uint8_t>> frames(count);
+	for (vector<uint8_t> &frame: frames) {
+		frame.resize(FRAME_LEN);
+		for (size_t i = 0; i < FRAME_LEN - RX_KERNEL_NROOTS; i++)
+			frame[i] = rng();
+		encode_rs_8(frame.data(), &frame[FRAME_LEN - RX_KERNEL_NROOTS], 0);
+		for (size_t i = 0; i < FRAME_LEN; i++)
+			frame[i] ^= csp_randomizer[i % RANDOMIZER_LEN];
+		for (unsigned int e = 0; e < errors; e++)
+			frame[rng() % FRAME_LEN] ^= 1 + rng() % 255;
+	}
+	return frames;
+}
+
+
+template<typename Function>
+static double measure(const vector<vector<uint8_t>> &frames, Function process) {
+	vector<uint8_t> work(FRAME_LEN);
+	uint32_t sink = 0;
+	const auto start = chrono::steady_clock::now();
+	for (const vector<uint8_t> &frame: frames) {
+		memcpy(work.data(), frame.data(), FRAME_LEN);
+		sink += process(work.data());
+	}
+	const auto end = chrono::steady_clock::now();
+	if (sink == 0xDEADBEEF)
+		printf(" ");
+	return chrono::duration<double, nano>(end - start).count() / frames.size();
+}
+
+
+int main(int argc, char *argv[]) {
+
+	const size_t count = (argc > 1) ? atoi(argv[1]) : 100000;
+	mt19937 rng(1);
+
+	printf("%-12s %14s %14s\n", "errors", "separate [ns]", "fused [ns]");
+	for (unsigned int errors: { 0, 1, 4, 16 }) {
+		const vector<vector<uint8_t>> frames = make_frames(count, errors, rng);
+
+		const double separate = measure(frames, [](uint8_t *frame) {
+			for (unsigned int i = 0; i < FRAME_LEN; i++)
+				frame[i] ^= csp_randomizer[i & (RANDOMIZER_LEN - 1)];
+			uint8_t s[RX_KERNEL_NROOTS];
+			syndromes_scalar(frame, s);
+			const int ret = decode_rs_8_syndromes(frame, s, NULL, 0, 0);
+			return ret + crc32_reference(frame, CRC_LEN);
+		});
+
+		const double fused = measure(frames, [](uint8_t *frame) {
+			RxKernelResult pass;
+			rx_kernel(frame, FRAME_LEN, true, true, CRC_LEN, pass);
+			if (pass.syndrome_error == false)
+				return pass.crc;
+			const int ret = decode_rs_8_syndromes(frame, pass.syndromes, NULL, 0, 0);
+			return ret + crc32_reference(frame, CRC_LEN);
+		});
+
+		printf("%-12u %14.0f %14.0f\n", errors, separate, fused);
+	}
+
+	return 0;
+}
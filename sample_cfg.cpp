@@ -60,6 +60,22 @@ GMSKContinousDemodulator::Config cfg_gmsk_demodulator()
 }
 
 
+Squelch::Config cfg_squelch()
+{
+	Squelch::Config c;
+	c.sample_rate = sdr_conf.samplerate;
+	c.center_frequency = CENTER_FREQUENCY - sdr_conf.rx_centerfreq;
+	c.bandwidth = 25e3; // 9600 baud GMSK and the residual Doppler
+	c.threshold = 0; // [dB] 0 = pass everything. E.g. 3 demodulates only when there is a signal.
+	c.hang_time = 100; // [ms]
+	c.preroll = 20; // [ms]
+	c.noise_time = 1000; // [ms]
+	c.verbose = false;
+
+	return c;
+}
+
+
 GolayDeframer::Config cfg_golay_deframer()
 {
 	GolayDeframer::Config c;
@@ -90,6 +106,18 @@ GMSKModulator::Config cfg_gmsk_modulator()
 }
 
 
+TxSampleBuffer::Config cfg_tx_sample_buffer()
+{
+	TxSampleBuffer::Config c;
+	c.sample_rate = sdr_conf.samplerate;
+	c.lookahead = sdr_conf.samplerate / 50; // [samples] 20 ms modulated ahead of the SDR
+	c.chunk_size = sdr_conf.buffer;
+	c.idle_poll = 1; // [ms]
+
+	return c;
+}
+
+
 GolayFramer::Config cfg_golay_framer()
 {
 	GolayFramer::Config c;
@@ -112,9 +140,36 @@ CSPSuoAdapter::Config cfg_csp_suo_adapter()
 	c.rx_use_hmac = false;
 	c.rx_legacy_hmac = false;
 	// c.rx_hmac_key;
+	// Keys of other satellites or the next key of a rotation:
+	// HmacKey key; memcpy(key.key, ..., 16); key.src = 5; c.rx_hmac_keys.push_back(key);
 	c.rx_use_xtea = false;
 	// c.rx_xtea_key;
-	c.rx_filter_ground_addresses = true;
+	// Drop the frames from the ground segment before decrypting them
+	c.rx_filter_rules.clear();
+	RxFilterRule ground("ground segment", false);
+	ground.src = RxFilterRule::range(9, 31);
+	c.rx_filter_rules.push_back(ground);
+	c.rx_filter_default_accept = true;
+	c.rx_workers = 2; // Decode off the DSP thread
+	c.rx_queue_depth = 64; // [frames]
+	c.rx_drop_oldest = true; // Prefer fresh telemetry when the decoder can't keep up
+	c.rx_batch = 8; // Frames decoded together when they queue up
+	c.rx_max_erasures = 20; // Used when RS is decoded by the adapter (use_libfec). Rest of the parity detects wrong decodings.
+	c.rx_erasure_threshold = 32;
+	c.rx_combine_slots = 16; // Failed copies of repeated frames kept for combining (use_libfec)
+	c.rx_combine_window = 30000; // [ms]
+	c.rx_combine_max_ber = 0.1;
+
+	c.rx_sfp_reassembly = true; // Coalesce SFP downloads for the ZMQ clients
+	c.rx_sfp_max_size = 1024; // [bytes] ZMQ interface MTU
+	c.rx_sfp_connections = 4;
+	c.rx_sfp_timeout = 2000; // [ms]
+
+	// Diversity combining with a second receiving station:
+	// c.rx_diversity_station = 0;
+	// c.rx_diversity_publish = "tcp://0.0.0.0:7010";
+	// c.rx_diversity_peers.push_back("tcp://station2:7010");
+	// c.rx_diversity_deliver = true; // false on the other stations
 
 	c.tx_use_rs = false;  // Done by GolayFramer
 	c.tx_use_crc = false;
@@ -129,6 +184,26 @@ CSPSuoAdapter::Config cfg_csp_suo_adapter()
 	c.tx_use_xtea = false;
 	// c.tx_xtea_key
 
+	c.tx_queue_depth = 32; // [packets per priority]
+	c.tx_weighted_scheduling = false; // Strict priority
+	c.tx_ttl[CSP_PRIO_LOW] = 60000; // [ms] Drop stale bulk data
+
+	c.tx_burst_length = 8; // [frames] Receiver must resynchronize from the syncword alone. 1 = no bursts
+
+	const GMSKModulator::Config modulator_conf = cfg_gmsk_modulator();
+	const GolayFramer::Config framer_conf = cfg_golay_framer();
+	c.tx_symbol_rate = modulator_conf.symbol_rate;
+	c.tx_interframe_gap = 96; // [symbols] ~10 ms receiver turnaround
+	c.tx_burst_overhead = framer_conf.preamble_len + modulator_conf.ramp_up_duration + modulator_conf.ramp_down_duration;
+	c.tx_frame_overhead = framer_conf.syncword_len + 24 + (framer_conf.use_rs ? 8 * 32 : 0); // Syncword, Golay header and RS parity
+
+	c.tx_spool_path = "uplink.spool"; // Frames received outside passes are stored here
+	c.tx_spool_slots = 256; // [frames]
+
+	c.tx_schedule_lead = 20000000; // [ns] Scheduled frames are modulated 20 ms ahead
+	c.tx_slot_length = 0; // [ns] No TDMA slots
+	c.tx_slot_count = 1;
+
 	return c;
 }
 
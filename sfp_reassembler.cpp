@@ -0,0 +1,173 @@
+#include "sfp_reassembler.hpp"
+#include "tx_scheduler.hpp"
+
+#include <csp/csp_endian.h>
+#include <string.h>
+
+using namespace std;
+using namespace suo;
+
+
+/* Trailer after the payload of every fragment (csp_sfp.c) */
+struct __attribute__((packed)) SfpTrailer {
+	uint32_t offset;      // Network byte order
+	uint32_t total_size;
+};
+
+
+/* Identifies the connection of a fragment */
+static uint32_t connection_key(const csp_id_t &id) {
+	return id.src | (id.dst << 5) | (id.dport << 10) | (id.sport << 16);
+}
+
+
+SfpReassembler::Config::Config() {
+	max_size = 1024;
+	connections = 4;
+	timeout = 2000;
+}
+
+
+SfpReassembler::SfpReassembler(const Config &_conf) :
+	conf(_conf),
+	transfers(_conf.connections)
+{
+	memset(&stats, 0, sizeof(stats));
+
+	if (conf.max_size <= sizeof(SfpTrailer))
+		throw SuoError("SfpReassembler: Invalid max_size");
+	if (conf.connections == 0)
+		throw SuoError("SfpReassembler: Invalid number of connections");
+
+	for (Transfer &transfer: transfers) {
+		transfer.active = false;
+		transfer.buffer.resize(conf.max_size);
+		transfer.used = 0;
+	}
+}
+
+
+bool SfpReassembler::isFragment(const csp_packet_t *packet) {
+	// Fragments of a connection using RDP, HMAC, XTEA or CRC32 have other data after the trailer
+	const uint8_t other_flags = CSP_FRDP | CSP_FHMAC | CSP_FXTEA | CSP_FCRC32;
+	return (packet->id.flags & CSP_FFRAG) && (packet->id.flags & other_flags) == 0 &&
+	       packet->length > sizeof(SfpTrailer);
+}
+
+
+SfpReassembler::Stats SfpReassembler::getStats() const {
+	lock_guard<mutex> guard(lock);
+	return stats;
+}
+
+
+void SfpReassembler::flush(Transfer &transfer) {
+	if (transfer.used == 0)
+		return;
+
+	if (transfer.start == 0 && transfer.used == transfer.total_size)
+		stats.completed++;
+	else
+		stats.flushed++;
+
+	SfpTrailer trailer;
+	trailer.offset = csp_hton32(transfer.start);
+	trailer.total_size = csp_hton32(transfer.total_size);
+	memcpy(&transfer.buffer[transfer.used], &trailer, sizeof(trailer));
+
+	sinkPacket.emit(transfer.id, transfer.buffer.data(), transfer.used + sizeof(trailer));
+
+	transfer.start = transfer.next;
+	transfer.used = 0;
+}
+
+
+void SfpReassembler::push(csp_packet_t *packet) {
+
+	const size_t len = packet->length - sizeof(SfpTrailer);
+	SfpTrailer trailer;
+	memcpy(&trailer, &packet->data[len], sizeof(trailer));
+	const uint32_t offset = csp_ntoh32(trailer.offset);
+	const uint32_t total_size = csp_ntoh32(trailer.total_size);
+	const uint32_t key = connection_key(packet->id);
+	const size_t capacity = conf.max_size - sizeof(SfpTrailer);
+
+	lock_guard<mutex> guard(lock);
+	stats.fragments++;
+	const uint64_t now = tx_clock_ms();
+
+	Transfer *transfer = nullptr;
+	for (Transfer &t: transfers) {
+		if (t.active && t.key == key) {
+			transfer = &t;
+			break;
+		}
+	}
+
+	if (transfer != nullptr && (offset != transfer->next || total_size != transfer->total_size)) {
+		// Fragment lost, repeated or a new transfer. Emit what has been collected.
+		stats.gaps++;
+		flush(*transfer);
+		transfer->active = false;
+	}
+
+	if (transfer == nullptr || transfer->active == false) {
+		if (transfer == nullptr) {
+			// Free buffer or the least recently used transfer
+			transfer = &transfers[0];
+			for (Transfer &t: transfers) {
+				if (t.active == false || t.last_time < transfer->last_time)
+					transfer = &t;
+				if (t.active == false)
+					break;
+			}
+			if (transfer->active) {
+				stats.evicted++;
+				flush(*transfer);
+			}
+		}
+
+		transfer->active = true;
+		transfer->key = key;
+		transfer->id = packet->id;
+		transfer->total_size = total_size;
+		transfer->start = offset;
+		transfer->next = offset;
+		transfer->used = 0;
+	}
+
+	if (transfer->used + len > capacity)
+		flush(*transfer);
+
+	if (len > capacity) {
+		// Larger than the buffer: Pass as it is
+		sinkPacket.emit(packet->id, packet->data, packet->length);
+		transfer->start += len;
+	}
+	else {
+		memcpy(&transfer->buffer[transfer->used], packet->data, len);
+		transfer->used += len;
+	}
+	transfer->next += len;
+	transfer->last_time = now;
+
+	if (transfer->next >= transfer->total_size) {
+		flush(*transfer);
+		transfer->active = false;
+	}
+
+	csp_buffer_free(packet);
+}
+
+
+void SfpReassembler::tick() {
+	lock_guard<mutex> guard(lock);
+	const uint64_t now = tx_clock_ms();
+	for (Transfer &transfer: transfers) {
+		if (transfer.active && transfer.last_time + conf.timeout < now) {
+			stats.timeouts++;
+			flush(transfer);
+			transfer.active = false;
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+#include <suo.hpp>
+#include <csp/csp.h>
+
+
+/*
+ * Coalesces the fragments of the CSP small fragment protocol (SFP) received over the
+ * radio into fragments of up to max_size bytes for the ground clients.
+ *
+ * An SFP fragment has the CSP_FFRAG flag and the payload is followed by a trailer
+ * holding the offset of the fragment and the total size of the transfer. The
+ * output is in the same format, so the clients' SFP receivers work unchanged, but
+ * a transfer fitting in max_size arrives as a single packet. Fragments are collected
+ * per connection (src, dst, sport, dport) in pre-allocated buffers. When a fragment
+ * is missing or the transfer stalls, the data collected so far is emitted as it is.
+ * Thread safe.
+ */
+class SfpReassembler
+{
+public:
+	struct Config {
+		Config();
+
+		unsigned int max_size;        // Maximum output payload including the trailer [bytes]
+		unsigned int connections;     // Maximum number of transfers in progress
+		unsigned int timeout;         // Transfer is flushed if no fragment arrives in this time [ms]
+	};
+
+	struct Stats {
+		unsigned int fragments;       // Fragments received
+		unsigned int completed;       // Transfers emitted as a single packet
+		unsigned int flushed;         // Partial transfers emitted
+		unsigned int timeouts;        // Transfers flushed because of the timeout
+		unsigned int gaps;            // Missing or out of order fragments
+		unsigned int evicted;         // Transfers flushed to make room for a new connection
+	};
+
+	explicit SfpReassembler(const Config &conf = Config());
+
+	SfpReassembler(const SfpReassembler &) = delete;
+	SfpReassembler &operator=(const SfpReassembler &) = delete;
+
+	/* Returns true if the packet is an SFP fragment which can be reassembled */
+	static bool isFragment(const csp_packet_t *packet);
+
+	/* Take a fragment (header in host byte order). The packet is freed. */
+	void push(csp_packet_t *packet);
+
+	/* Flush the stalled transfers */
+	void tick();
+
+	/* Output packet: CSP header (host byte order), payload with the SFP trailer and length */
+	suo::Port<csp_id_t, const uint8_t*, size_t> sinkPacket;
+
+	Stats getStats() const;
+
+private:
+	struct Transfer {
+		bool active;
+		uint32_t key;               // src, dst, sport and dport of the CSP header
+		csp_id_t id;
+		uint32_t total_size;
+		uint32_t start;             // Offset of the first byte in the buffer
+		uint32_t next;              // Offset of the next expected fragment
+		uint64_t last_time;         // [ms]
+		std::vector<uint8_t> buffer;
+		size_t used;
+	};
+
+	/* Emit the collected data as a fragment. Called with lock held. */
+	void flush(Transfer &transfer);
+
+	Config conf;
+	Stats stats;
+	mutable std::mutex lock;
+	std::vector<Transfer> transfers;
+};
@@ -0,0 +1,251 @@
+#include "squelch.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+using namespace suo;
+
+
+/* Number of parallel partial sums in the mixer loop so that the compiler can vectorize it */
+#define MIXER_LANES  8
+
+
+Squelch::Config::Config() {
+	sample_rate = 1e6;
+	center_frequency = 0;
+	bandwidth = 25e3;
+	threshold = 0;
+	hang_time = 100;
+	preroll = 20;
+	noise_time = 1000;
+	verbose = false;
+}
+
+
+Squelch::Squelch(const Config &_conf) :
+	conf(_conf),
+	block_pos(0),
+	acc_re(0),
+	acc_im(0),
+	power(0),
+	noise_floor(0),
+	mixer_pending(false),
+	open(false),
+	locked(false),
+	open_until(0),
+	preroll_first(0),
+	preroll_count(0),
+	preroll_samples(0)
+{
+	stats.openings = 0;
+	stats.samples = 0;
+	stats.passed = 0;
+
+	if (conf.sample_rate <= 0 || conf.bandwidth <= 0 || conf.bandwidth > conf.sample_rate)
+		throw SuoError("Squelch: Invalid bandwidth");
+
+	block_len = max<size_t>(1, lrintf(conf.sample_rate / conf.bandwidth));
+	mixer_re.resize(block_len);
+	mixer_im.resize(block_len);
+	updateMixer(conf.center_frequency, mixer_re, mixer_im);
+	mixer_next_re.resize(block_len);
+	mixer_next_im.resize(block_len);
+
+	threshold_ratio = powf(10, conf.threshold / 10);
+	noise_samples = conf.noise_time * conf.sample_rate / 1000;
+	hang_samples = conf.hang_time * conf.sample_rate / 1000;
+	preroll_max = conf.preroll * conf.sample_rate / 1000;
+	open = (conf.threshold <= 0);
+}
+
+
+void Squelch::updateMixer(float frequency, vector<float> &re, vector<float> &im) const {
+	const double w = -2 * M_PI * frequency / conf.sample_rate;
+	for (size_t n = 0; n < block_len; n++) {
+		re[n] = cos(w * n);
+		im[n] = sin(w * n);
+	}
+}
+
+
+void Squelch::setFrequencyOffset(float frequency_offset) {
+	// The table in use belongs to the SDR thread. The new one is swapped in by sinkSamples.
+	lock_guard<mutex> lock(mixer_lock);
+	updateMixer(conf.center_frequency + frequency_offset, mixer_next_re, mixer_next_im);
+	mixer_pending = true;
+}
+
+
+bool Squelch::measurePower(const SampleVector &samples, float &mean_power) {
+
+	const float *x = reinterpret_cast<const float*>(samples.data());
+	float total = 0;
+	unsigned int blocks = 0;
+
+	size_t i = 0;
+	while (i < samples.size()) {
+		const size_t count = min(samples.size() - i, block_len - block_pos);
+		const float *xs = x + 2 * i;
+		const float *tr = &mixer_re[block_pos], *ti = &mixer_im[block_pos];
+
+		// Complex dot product of the samples and the mixer with independent partial sums
+		float re[MIXER_LANES] = { 0 }, im[MIXER_LANES] = { 0 };
+		size_t k = 0;
+		for (; k + MIXER_LANES <= count; k += MIXER_LANES) {
+			for (unsigned int j = 0; j < MIXER_LANES; j++) {
+				const float xr = xs[2 * (k + j)], xi = xs[2 * (k + j) + 1];
+				re[j] += xr * tr[k + j] - xi * ti[k + j];
+				im[j] += xr * ti[k + j] + xi * tr[k + j];
+			}
+		}
+		for (; k < count; k++) {
+			const float xr = xs[2 * k], xi = xs[2 * k + 1];
+			re[0] += xr * tr[k] - xi * ti[k];
+			im[0] += xr * ti[k] + xi * tr[k];
+		}
+		for (unsigned int j = 0; j < MIXER_LANES; j++) {
+			acc_re += re[j];
+			acc_im += im[j];
+		}
+
+		i += count;
+		block_pos += count;
+		if (block_pos == block_len) {
+			total += (acc_re * acc_re + acc_im * acc_im) / block_len;
+			blocks++;
+			acc_re = acc_im = 0;
+			block_pos = 0;
+		}
+	}
+
+	if (blocks == 0)
+		return false;
+	mean_power = total / blocks;
+	return true;
+}
+
+
+void Squelch::storePreroll(const SampleVector &samples, Timestamp now) {
+	if (preroll_max == 0)
+		return;
+
+	if (preroll_count == preroll.size()) {
+		// Ring is full: Grow it keeping the order
+		rotate(preroll.begin(), preroll.begin() + preroll_first, preroll.end());
+		preroll_first = 0;
+		preroll.emplace_back();
+	}
+
+	PrerollBuffer &buffer = preroll[(preroll_first + preroll_count) % preroll.size()];
+	buffer.samples.assign(samples.begin(), samples.end());
+	buffer.samples.timestamp = samples.timestamp;
+	buffer.samples.flags = samples.flags;
+	buffer.timestamp = now;
+	preroll_count++;
+	preroll_samples += samples.size();
+
+	// Drop the oldest buffers which aren't needed for the pre-roll
+	while (preroll_count > 1 && preroll_samples - preroll[preroll_first].samples.size() >= preroll_max) {
+		preroll_samples -= preroll[preroll_first].samples.size();
+		preroll_first = (preroll_first + 1) % preroll.size();
+		preroll_count--;
+	}
+}
+
+
+void Squelch::sinkSamples(const SampleVector &samples, Timestamp now) {
+
+	stats.samples += samples.size();
+
+	if (conf.threshold <= 0) {
+		stats.passed += samples.size();
+		sinkPassedSamples.emit(samples, now);
+		return;
+	}
+
+	// Take the new mixer table unless the tracker is still computing it
+	if (mixer_pending && mixer_lock.try_lock()) {
+		mixer_re.swap(mixer_next_re);
+		mixer_im.swap(mixer_next_im);
+		mixer_pending = false;
+		mixer_lock.unlock();
+	}
+
+	float measured;
+	if (measurePower(samples, measured)) {
+		power = measured;
+		const bool signal = (noise_floor > 0 && power > noise_floor * threshold_ratio);
+
+		/*
+		 * Noise floor is the average of the power below the threshold. It follows a large drop
+		 * (e.g. gain change) fast. A signal above the threshold raises it only very slowly.
+		 */
+		const float alpha = min(1.0f, samples.size() / noise_samples);
+		if (noise_floor == 0)
+			noise_floor = power;
+		else if (power * threshold_ratio < noise_floor)
+			noise_floor += min(1.0f, 8 * alpha) * (power - noise_floor);
+		else if (signal == false)
+			noise_floor += alpha * (power - noise_floor);
+		else if (locked == false)
+			noise_floor += (alpha / 16) * (power - noise_floor);
+
+		if (signal)
+			open_until = stats.samples + hang_samples;
+	}
+
+	if (open == false && stats.samples < open_until) {
+		open = true;
+		stats.openings++;
+		if (conf.verbose)
+			cerr << "Squelch open: power " << getPower() << " dB, noise floor " << getNoiseFloor() << " dB" << endl;
+
+		// Pass the pre-roll before the samples which opened the squelch
+		for (; preroll_count > 0; preroll_count--) {
+			const PrerollBuffer &buffer = preroll[preroll_first];
+			stats.passed += buffer.samples.size();
+			sinkPassedSamples.emit(buffer.samples, buffer.timestamp);
+			preroll_first = (preroll_first + 1) % preroll.size();
+		}
+		preroll_samples = 0;
+	}
+	else if (open && locked == false && stats.samples >= open_until) {
+		open = false;
+		if (conf.verbose)
+			cerr << "Squelch closed: duty cycle " << 100 * getDutyCycle() << " %" << endl;
+	}
+
+	if (open) {
+		stats.passed += samples.size();
+		sinkPassedSamples.emit(samples, now);
+	}
+	else
+		storePreroll(samples, now);
+}
+
+
+void Squelch::lockReceiver(bool _locked, Timestamp now) {
+	(void)now;
+	locked = _locked;
+	if (locked == false && open)
+		open_until = max(open_until, stats.samples + hang_samples);
+}
+
+
+float Squelch::getPower() const {
+	return 10 * log10f(power);
+}
+
+
+float Squelch::getNoiseFloor() const {
+	return 10 * log10f(noise_floor);
+}
+
+
+float Squelch::getDutyCycle() const {
+	if (stats.samples == 0)
+		return 0;
+	return (float)stats.passed / stats.samples;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+#include <suo.hpp>
+
+
+/*
+ * Energy detecting squelch between the SDR and the demodulator.
+ *
+ * The in-band power of the downlink channel is measured by mixing the samples down
+ * to baseband and integrating them over blocks of sample_rate / bandwidth samples
+ * (boxcar low-pass filter and decimation). The noise floor is tracked while the
+ * channel is idle. When the power rises `threshold` dB above the floor, the squelch
+ * opens and the samples are passed to the demodulator, starting with the buffered
+ * pre-roll so the preamble and the syncword of the first frame aren't lost. The
+ * squelch closes after `hang_time` of quiet unless a frame is being received.
+ * Samples of the idle channel are not passed at all.
+ *
+ * The squelch is disabled (threshold 0) by default and passes every sample. A threshold
+ * of a few dB saves the demodulator's CPU time between the passes, but it can also gate
+ * out the weakest frames at the ends of a pass.
+ */
+class Squelch : public suo::Block
+{
+public:
+	struct Config {
+		Config();
+
+		/* Sample rate [Hz] */
+		float sample_rate;
+
+		/* Center frequency of the channel relative to the SDR center frequency [Hz] */
+		float center_frequency;
+
+		/* Bandwidth of the power detector including the Doppler shift [Hz] */
+		float bandwidth;
+
+		/* Opening threshold above the noise floor [dB], e.g. 3. 0 = always open (default) */
+		float threshold;
+
+		/* Time the squelch stays open after the signal has dropped [ms] */
+		unsigned int hang_time;
+
+		/* Samples buffered while closed and passed before the samples opening the squelch [ms] */
+		unsigned int preroll;
+
+		/* Time constant of the rising noise floor estimate [ms] */
+		unsigned int noise_time;
+
+		bool verbose;
+	};
+
+	struct Stats {
+		unsigned int openings;       // Number of times the squelch has opened
+		uint64_t samples;            // Samples received
+		uint64_t passed;             // Samples passed to the demodulator (including the pre-roll)
+	};
+
+	explicit Squelch(const Config &conf = Config());
+
+	Squelch(const Squelch &) = delete;
+	Squelch &operator=(const Squelch &) = delete;
+
+	/* Sink samples from the SDR (suo callback function) */
+	void sinkSamples(const suo::SampleVector &samples, suo::Timestamp now);
+
+	/* Keep the squelch open while the deframer is receiving a frame (suo callback function) */
+	void lockReceiver(bool locked, suo::Timestamp now);
+
+	/* Follow the Doppler shift of the channel [Hz]. Can be called from any thread. */
+	void setFrequencyOffset(float frequency_offset);
+
+	/* Output for the samples passing the squelch */
+	suo::Port<const suo::SampleVector &, suo::Timestamp> sinkPassedSamples;
+
+	bool isOpen() const { return open; }
+
+	/* Latest in-band power and noise floor [dB] */
+	float getPower() const;
+	float getNoiseFloor() const;
+
+	/* Fraction of the samples passed to the demodulator */
+	float getDutyCycle() const;
+
+	const Stats &getStats() const { return stats; }
+
+private:
+	/* Compute the mixer table for the channel frequency */
+	void updateMixer(float frequency, std::vector<float> &re, std::vector<float> &im) const;
+
+	/* Mean in-band power of the completed blocks of the buffer. Returns false if no block was completed. */
+	bool measurePower(const suo::SampleVector &samples, float &power);
+
+	/* Keep the samples of the closed squelch for the pre-roll */
+	void storePreroll(const suo::SampleVector &samples, suo::Timestamp now);
+
+	Config conf;
+	Stats stats;
+
+	/* Power detector */
+	size_t block_len;                  // Integration block length [samples]
+	std::vector<float> mixer_re;       // exp(-j w n) for one block
+	std::vector<float> mixer_im;
+	size_t block_pos;                  // Position in the current block
+	float acc_re, acc_im;              // Accumulator of the current block
+	float power;                       // Latest measured power
+	float noise_floor;                 // 0 = not yet measured
+	float noise_samples;               // Time constant of the floor [samples]
+
+	/* Mixer table for a new frequency. Swapped in by the SDR thread. */
+	std::mutex mixer_lock;
+	std::vector<float> mixer_next_re;
+	std::vector<float> mixer_next_im;
+	std::atomic<bool> mixer_pending;
+
+	/* Gate */
+	bool open;
+	bool locked;
+	uint64_t open_until;               // Sample count when the hang time ends
+	uint64_t hang_samples;
+	float threshold_ratio;             // Threshold as a power ratio
+
+	/* Pre-roll ring */
+	struct PrerollBuffer {
+		suo::SampleVector samples;
+		suo::Timestamp timestamp;
+	};
+	std::vector<PrerollBuffer> preroll;
+	size_t preroll_first;              // Oldest buffer in the ring
+	size_t preroll_count;              // Buffers in the ring
+	size_t preroll_samples;            // Samples in the ring
+	size_t preroll_max;                // [samples]
+};
@@ -0,0 +1,86 @@
+#include "symbol_reliability.hpp"
+
+#include <string.h>
+
+using namespace std;
+using namespace suo;
+
+
+SymbolReliability::Config::Config() {
+	max_frame_len = 255;
+}
+
+
+SymbolReliability::SymbolReliability(const Config &_conf) :
+	conf(_conf),
+	history(8 * _conf.max_frame_len, 0),
+	position(0),
+	received(0)
+{
+	if (conf.max_frame_len == 0)
+		throw SuoError("SymbolReliability: Invalid max_frame_len");
+}
+
+
+void SymbolReliability::sinkSymbol(Symbol symbol, Timestamp now) {
+	(void)now;
+
+	// Distance from the decision threshold 127.5
+	history[position] = (symbol >= 128) ? (symbol - 128) : (127 - symbol);
+	if (++position == history.size())
+		position = 0;
+	if (received < history.size())
+		received++;
+}
+
+
+bool SymbolReliability::getByteReliability(size_t len, uint8_t *reliability) const {
+	if (8 * len > received)
+		return false;
+
+	size_t i = (position + history.size() - 8 * len) % history.size();
+	for (size_t byte = 0; byte < len; byte++) {
+		uint8_t weakest = 127;
+		for (unsigned int bit = 0; bit < 8; bit++) {
+			weakest = min(weakest, history[i]);
+			if (++i == history.size())
+				i = 0;
+		}
+		reliability[byte] = weakest;
+	}
+	return true;
+}
+
+
+int select_erasures(const uint8_t *reliability, size_t len, unsigned int max_erasures,
+                    uint8_t threshold, int *eras_pos) {
+
+	if (max_erasures == 0 || threshold == 0)
+		return 0;
+
+	/* Find the reliability limit which gives at most max_erasures bytes */
+	unsigned int histogram[256];
+	memset(histogram, 0, threshold * sizeof(unsigned int));
+	for (size_t i = 0; i < len; i++) {
+		if (reliability[i] < threshold)
+			histogram[reliability[i]]++;
+	}
+
+	unsigned int limit = 0, count = 0;
+	while (limit < threshold && count + histogram[limit] <= max_erasures)
+		count += histogram[limit++];
+
+	// Bytes below the limit fit completely. Fill the rest with bytes at the limit.
+	unsigned int at_limit = (limit < threshold) ? (max_erasures - count) : 0;
+
+	int no_eras = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (reliability[i] < limit)
+			eras_pos[no_eras++] = i;
+		else if (reliability[i] == limit && at_limit > 0) {
+			eras_pos[no_eras++] = i;
+			at_limit--;
+		}
+	}
+	return no_eras;
+}
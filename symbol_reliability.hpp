@@ -0,0 +1,54 @@
+#pragma once
+
+#include <suo.hpp>
+#include <vector>
+#include <stdint.h>
+
+
+/*
+ * Keeps track of the reliability of the latest received symbols so that the
+ * bytes of a received frame can be given a reliability for erasure decoding.
+ *
+ * The symbols are soft bits from the demodulator: 0 = strong zero, 255 = strong one.
+ * The reliability of a byte is the distance of its weakest bit from the decision
+ * threshold (0 = no information, 127 = certain). The deframer emits a frame right
+ * after its last symbol, so the frame's bytes are the latest 8 * len symbols.
+ * Not usable with convolutional coding (use_viterbi).
+ */
+class SymbolReliability : public suo::Block
+{
+public:
+	struct Config {
+		Config();
+
+		/* Longest frame [bytes] */
+		unsigned int max_frame_len;
+	};
+
+	explicit SymbolReliability(const Config &conf = Config());
+
+	/* Sink a symbol from the demodulator (suo callback function) */
+	void sinkSymbol(suo::Symbol symbol, suo::Timestamp now);
+
+	/*
+	 * Reliability of the latest `len` bytes in the order of reception.
+	 * Returns false if not enough symbols have been received.
+	 */
+	bool getByteReliability(size_t len, uint8_t *reliability) const;
+
+private:
+	Config conf;
+	std::vector<uint8_t> history;   // Ring buffer of bit reliabilities
+	size_t position;                // Next write position
+	size_t received;                // Number of symbols received (saturates to history size)
+};
+
+
+/*
+ * Select the least reliable bytes of a codeword as erasures for the Reed-Solomon decoder.
+ * Only bytes with reliability below `threshold` are selected, at most `max_erasures`.
+ * Runs in linear time using a histogram of the reliabilities.
+ * Returns the number of erasures written to `eras_pos`.
+ */
+int select_erasures(const uint8_t *reliability, size_t len, unsigned int max_erasures,
+                    uint8_t threshold, int *eras_pos);
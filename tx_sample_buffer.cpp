@@ -0,0 +1,200 @@
+#include "tx_sample_buffer.hpp"
+
+#include <chrono>
+#include <climits>
+#include <string.h>
+
+using namespace std;
+using namespace suo;
+
+
+TxSampleBuffer::Config::Config() {
+	sample_rate = 1e6;
+	lookahead = 20000;
+	chunk_size = 1000;
+	idle_poll = 1;
+}
+
+
+/* Number of chunks needed to cover the look-ahead */
+static size_t chunk_count(const TxSampleBuffer::Config &conf) {
+	if (conf.chunk_size == 0)
+		throw SuoError("TxSampleBuffer: Invalid chunk size");
+	return max<size_t>(2, (conf.lookahead + conf.chunk_size - 1) / conf.chunk_size);
+}
+
+
+TxSampleBuffer::TxSampleBuffer(const Config &_conf) :
+	conf(_conf),
+	free_chunks(chunk_count(_conf)),
+	ready_chunks(chunk_count(_conf)),
+	free_sem(0),
+	running(false),
+	buffered(0),
+	sdr_time(0),
+	producing_burst(false),
+	current(nullptr),
+	current_offset(0),
+	in_burst(false),
+	discarding(false)
+{
+	memset(&stats, 0, sizeof(stats));
+	stats.lead_min = UINT_MAX;
+
+	if (conf.sample_rate <= 0)
+		throw SuoError("TxSampleBuffer: Invalid sample rate");
+
+	const size_t n = chunk_count(conf);
+	chunks.resize(n);
+	for (SampleVector &chunk: chunks) {
+		chunk.reserve(conf.chunk_size);
+		free_chunks.push(&chunk);
+	}
+	free_sem.release(n);
+}
+
+
+TxSampleBuffer::~TxSampleBuffer() {
+	stop();
+}
+
+
+void TxSampleBuffer::start() {
+	if (running)
+		return;
+	running = true;
+	producer = thread(&TxSampleBuffer::producerLoop, this);
+}
+
+
+void TxSampleBuffer::stop() {
+	running = false;
+	free_sem.release();
+	if (producer.joinable())
+		producer.join();
+}
+
+
+void TxSampleBuffer::releaseChunk(SampleVector *chunk) {
+	buffered -= chunk->size();
+	free_chunks.push(chunk);
+	free_sem.release();
+}
+
+
+void TxSampleBuffer::producerLoop() {
+
+	while (running) {
+
+		// Wait for space in the buffer
+		if (free_sem.try_acquire_for(chrono::milliseconds(conf.idle_poll)) == false)
+			continue;
+
+		SampleVector *chunk;
+		if (free_chunks.pop(chunk) == false)
+			continue;
+
+		chunk->clear();
+		chunk->flags = 0;
+		chunk->timestamp = 0;
+
+		// The samples will be transmitted after everything already in the buffer
+		const Timestamp now = sdr_time + (Timestamp)(buffered * 1e9 / conf.sample_rate);
+		sourceSamples.emit(*chunk, now);
+
+		if (chunk->empty() && (chunk->flags & SampleVector::end_of_burst) == 0) {
+			// Nothing to transmit
+			free_chunks.push(chunk);
+			free_sem.release();
+			if (producing_burst == false)
+				this_thread::sleep_for(chrono::milliseconds(conf.idle_poll));
+			continue;
+		}
+
+		if (producing_burst == false)
+			chunk->flags |= SampleVector::start_of_burst;
+		if (chunk->size() < conf.chunk_size)
+			chunk->flags |= SampleVector::end_of_burst;
+		producing_burst = (chunk->flags & SampleVector::end_of_burst) == 0;
+
+		buffered += chunk->size();
+		ready_chunks.push(chunk);
+	}
+}
+
+
+void TxSampleBuffer::generateSamples(SampleVector &samples, Timestamp now) {
+
+	sdr_time = now;
+	const Timestamp duration = (Timestamp)(samples.capacity() * 1e9 / conf.sample_rate);
+
+	while (samples.size() < samples.capacity()) {
+
+		if (current == nullptr) {
+			if (ready_chunks.pop(current) == false) {
+				current = nullptr;
+				if (in_burst) {
+					// Producer didn't keep up. Rest of the burst will be transmitted when available.
+					stats.underruns++;
+					in_burst = false;
+				}
+				break;
+			}
+			current_offset = 0;
+		}
+
+		if (current_offset == 0 && (current->flags & SampleVector::start_of_burst)) {
+			// Every burst begins in a new sample buffer
+			if (samples.empty() == false)
+				break;
+
+			discarding = false;
+			if (current->flags & SampleVector::has_timestamp) {
+				if (current->timestamp < now) {
+					stats.late++;
+					discarding = true;
+				}
+				else if (current->timestamp >= now + duration)
+					break; // Not yet
+				else {
+					samples.timestamp = current->timestamp;
+					samples.flags |= SampleVector::has_timestamp;
+				}
+			}
+
+			if (discarding == false) {
+				samples.flags |= SampleVector::start_of_burst;
+				stats.bursts++;
+			}
+		}
+
+		if (discarding)
+			current_offset = current->size();
+		else {
+			in_burst = true;
+			const size_t n = min(current->size() - current_offset, samples.capacity() - samples.size());
+			samples.insert(samples.end(), current->begin() + current_offset, current->begin() + current_offset + n);
+			current_offset += n;
+		}
+
+		if (current_offset == current->size()) {
+			const bool end_of_burst = (current->flags & SampleVector::end_of_burst) != 0;
+			releaseChunk(current);
+			current = nullptr;
+
+			if (end_of_burst) {
+				if (discarding == false)
+					samples.flags |= SampleVector::end_of_burst;
+				discarding = false;
+				in_burst = false;
+				break;
+			}
+		}
+	}
+
+	if (in_burst) {
+		const unsigned int lead = buffered - (current ? current_offset : 0);
+		stats.lead_min = min(stats.lead_min, lead);
+		stats.lead_max = max(stats.lead_max, lead);
+	}
+}
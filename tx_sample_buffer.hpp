@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <semaphore>
+#include <vector>
+
+#include <suo.hpp>
+
+#include "lockfree_queue.hpp"
+
+/*
+ * Look-ahead buffer between the modulator and the SDR.
+ *
+ * Framing and modulation run on a separate producer thread which keeps up to
+ * `lookahead` samples of the ongoing burst modulated ahead of time. The SDR
+ * callback only copies the ready samples so scheduling hiccups of the framer
+ * or the modulator don't cause a TX underrun in the middle of a frame.
+ *
+ * Samples are passed between the threads in chunks of `chunk_size` samples.
+ * Bursts are transmitted in the order they were modulated. A burst having
+ * a timestamp (SampleVector::has_timestamp) is held until its time and dropped
+ * if the time has already passed.
+ */
+class TxSampleBuffer : public suo::Block
+{
+public:
+
+	struct Config {
+		Config();
+
+		/* Sample rate [Hz] */
+		float sample_rate;
+
+		/* Maximum number of samples modulated ahead of the SDR [samples] */
+		unsigned int lookahead;
+
+		/* Number of samples requested from the modulator at a time [samples] */
+		unsigned int chunk_size;
+
+		/* How often the producer polls the idle modulator for a new burst [ms] */
+		unsigned int idle_poll;
+	};
+
+	struct Stats {
+		unsigned int bursts;     // Bursts passed to the SDR
+		unsigned int underruns;  // Samples weren't ready in the middle of a burst
+		unsigned int late;       // Timestamped bursts dropped because their time had passed
+		unsigned int lead_min;   // Minimum number of samples buffered ahead during a burst [samples]
+		unsigned int lead_max;   // Maximum number of samples buffered ahead during a burst [samples]
+	};
+
+	explicit TxSampleBuffer(const Config &conf = Config());
+	~TxSampleBuffer();
+
+	TxSampleBuffer(const TxSampleBuffer &) = delete;
+	TxSampleBuffer &operator=(const TxSampleBuffer &) = delete;
+
+	/* Start the producer thread. Call after the sourceSamples port has been connected. */
+	void start();
+
+	/* Stop the producer thread */
+	void stop();
+
+	/* Generate samples to be transmitted (suo callback function for the SDR) */
+	void generateSamples(suo::SampleVector &samples, suo::Timestamp now);
+
+	/* Number of samples currently modulated ahead of the SDR */
+	size_t getLead() const { return buffered; }
+
+	const Stats &getStats() const { return stats; }
+
+	/* Source port for the modulated samples (called from the producer thread) */
+	suo::Port<suo::SampleVector &, suo::Timestamp> sourceSamples;
+
+private:
+	void producerLoop();
+
+	/* Release a chunk back to the producer */
+	void releaseChunk(suo::SampleVector *chunk);
+
+	Config conf;
+
+	std::vector<suo::SampleVector> chunks;
+	LockFreeQueue<suo::SampleVector*> free_chunks;
+	LockFreeQueue<suo::SampleVector*> ready_chunks;
+	std::counting_semaphore<> free_sem;
+
+	std::atomic<bool> running;
+	std::thread producer;
+
+	std::atomic<size_t> buffered;          // Samples in ready chunks
+	std::atomic<suo::Timestamp> sdr_time;  // Timestamp of the next sample requested by the SDR
+
+	/* Producer thread state */
+	bool producing_burst;
+
+	/* SDR thread state */
+	suo::SampleVector *current;  // Chunk being copied to the SDR
+	size_t current_offset;
+	bool in_burst;
+	bool discarding;             // Dropping the rest of a late burst
+
+	Stats stats;
+};
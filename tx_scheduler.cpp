@@ -0,0 +1,150 @@
+#include "tx_scheduler.hpp"
+
+#include <chrono>
+
+using namespace std;
+
+
+uint64_t tx_clock_ms() {
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+TxScheduler::TxScheduler(unsigned int depth, bool _weighted,
+                         const unsigned int _weights[TX_PRIORITIES], const unsigned int _ttl[TX_PRIORITIES]) :
+	weighted(_weighted)
+{
+	for (unsigned int prio = 0; prio < TX_PRIORITIES; prio++) {
+		// Zero weight would starve the queue forever
+		weights[prio] = (_weights[prio] > 0) ? _weights[prio] : 1;
+		ttl[prio] = _ttl[prio];
+		credits[prio] = weights[prio];
+		queues[prio].reset(new LockFreeQueue<TxEntry>(depth));
+	}
+}
+
+
+bool TxScheduler::push(TxEntry entry) {
+	const unsigned int prio = entry.id.pri;
+	if (entry.deadline == 0)
+		entry.deadline = deadline(prio);
+	return queues[prio]->push(entry);
+}
+
+
+uint64_t TxScheduler::deadline(unsigned int prio) const {
+	return (ttl[prio] > 0) ? (tx_clock_ms() + ttl[prio]) : 0;
+}
+
+
+bool TxScheduler::pop(TxEntry &entry) {
+
+	if (weighted == false) {
+		/* Strict priority: Always serve the most important non-empty queue */
+		for (unsigned int prio = 0; prio < TX_PRIORITIES; prio++) {
+			if (queues[prio]->pop(entry))
+				return true;
+		}
+		return false;
+	}
+
+	/* Weighted round-robin: Each priority can send `weight` packets per round */
+	for (int round = 0; round < 2; round++) {
+		for (unsigned int prio = 0; prio < TX_PRIORITIES; prio++) {
+			if (credits[prio] == 0)
+				continue;
+			if (queues[prio]->pop(entry)) {
+				credits[prio]--;
+				return true;
+			}
+		}
+
+		// All the queues with packets have used their credits. Start a new round.
+		for (unsigned int prio = 0; prio < TX_PRIORITIES; prio++)
+			credits[prio] = weights[prio];
+	}
+	return false;
+}
+
+
+size_t TxScheduler::size() const {
+	size_t total = 0;
+	for (unsigned int prio = 0; prio < TX_PRIORITIES; prio++)
+		total += queues[prio]->size();
+	return total;
+}
+
+
+TxTimeQueue::TxTimeQueue(unsigned int _depth) :
+	depth(_depth)
+{
+}
+
+
+bool TxTimeQueue::push(const TxEntry &entry) {
+	lock_guard<mutex> guard(lock);
+	if (entries.size() >= depth)
+		return false;
+	entries.emplace(entry.tx_time, entry);
+	return true;
+}
+
+
+bool TxTimeQueue::peek(suo::Timestamp &tx_time) const {
+	lock_guard<mutex> guard(lock);
+	if (entries.empty())
+		return false;
+	tx_time = entries.begin()->first;
+	return true;
+}
+
+
+bool TxTimeQueue::pop(TxEntry &entry) {
+	lock_guard<mutex> guard(lock);
+	if (entries.empty())
+		return false;
+	entry = entries.begin()->second;
+	entries.erase(entries.begin());
+	return true;
+}
+
+
+size_t TxTimeQueue::size() const {
+	lock_guard<mutex> guard(lock);
+	return entries.size();
+}
+
+
+TxPacer::TxPacer(float _symbol_rate, unsigned int _gap) :
+	symbol_rate(_symbol_rate),
+	gap(_gap),
+	busy_until(0)
+{
+}
+
+
+suo::Timestamp TxPacer::symbolsToTime(unsigned int symbols) const {
+	return (suo::Timestamp)(1e9 * symbols / symbol_rate);
+}
+
+
+bool TxPacer::ready(suo::Timestamp now) const {
+	if (symbol_rate <= 0)
+		return true;
+	return now >= busy_until + symbolsToTime(gap);
+}
+
+
+void TxPacer::transmitted(suo::Timestamp now, unsigned int symbols) {
+	if (symbol_rate <= 0)
+		return;
+	// Frames of the same burst are queued right after each other
+	busy_until = max(now, busy_until) + symbolsToTime(symbols);
+}
+
+
+bool TxPacer::fits(suo::Timestamp now, unsigned int symbols, suo::Timestamp before) const {
+	if (symbol_rate <= 0)
+		return true;
+	return max(now, busy_until) + symbolsToTime(symbols + gap) <= before;
+}
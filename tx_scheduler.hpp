@@ -0,0 +1,151 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+
+#include <suo.hpp>
+#include <csp/csp.h>
+
+#include "lockfree_queue.hpp"
+
+/* Number of CSP priority levels (CSP_PRIO_CRITICAL ... CSP_PRIO_LOW) */
+#define TX_PRIORITIES  4
+
+/* Milliseconds from a monotonic clock */
+uint64_t tx_clock_ms();
+
+
+/*
+ * Packet waiting for the transmission
+ */
+struct TxEntry {
+	csp_packet_t *packet;  // Encoded frame bytes starting from packet->id
+	csp_id_t id;           // Original CSP header in host byte order
+	uint16_t length;       // Original CSP payload length
+	uint32_t seq;          // Sequence number given by the adapter
+	uint64_t deadline;     // Packet is dropped if not transmitted before this [ms]. 0 = no deadline
+	suo::Timestamp tx_time;  // SDR time when the burst must start [ns]. 0 = as soon as possible
+};
+
+
+/*
+ * Uplink scheduler with separate queue for each CSP priority.
+ * Producer (CSP router) and consumer (suo) can run in different threads.
+ */
+class TxScheduler
+{
+public:
+
+	/*
+	 * depth: Maximum number of packets in each priority queue
+	 * weighted: Use weighted round-robin instead of strict priority ordering
+	 * weights: Number of packets served from each priority per round (weighted mode only)
+	 * ttl: Time to live for packets in each priority queue [ms]. 0 = no limit
+	 */
+	TxScheduler(unsigned int depth, bool weighted,
+	            const unsigned int weights[TX_PRIORITIES], const unsigned int ttl[TX_PRIORITIES]);
+
+	TxScheduler(const TxScheduler &) = delete;
+	TxScheduler &operator=(const TxScheduler &) = delete;
+
+	/*
+	 * Add packet to the queue matching its priority. The deadline is set by the scheduler
+	 * unless the entry has one already, e.g. a frame restored from the spool.
+	 * Returns false if the queue is full.
+	 */
+	bool push(TxEntry entry);
+
+	/* Deadline for a packet of the given priority queued now [ms]. 0 = no deadline */
+	uint64_t deadline(unsigned int prio) const;
+
+	/* Take the next packet to be transmitted. Returns false if all queues are empty. */
+	bool pop(TxEntry &entry);
+
+	/* Total number of packets waiting */
+	size_t size() const;
+
+	/* Number of packets waiting in given priority */
+	size_t size(unsigned int prio) const { return queues[prio]->size(); }
+
+	size_t capacity() const { return queues[0]->capacity(); }
+
+private:
+	bool weighted;
+	unsigned int weights[TX_PRIORITIES];
+	unsigned int ttl[TX_PRIORITIES];
+	unsigned int credits[TX_PRIORITIES];
+
+	std::unique_ptr<LockFreeQueue<TxEntry>> queues[TX_PRIORITIES];
+};
+
+
+/*
+ * Frames scheduled for a specific SDR time, ordered by the time.
+ * Producer (encoder) and consumer (suo) can run in different threads.
+ */
+class TxTimeQueue
+{
+public:
+	/* depth: Maximum number of scheduled frames */
+	explicit TxTimeQueue(unsigned int depth);
+
+	TxTimeQueue(const TxTimeQueue &) = delete;
+	TxTimeQueue &operator=(const TxTimeQueue &) = delete;
+
+	/* Add a frame. Returns false if the queue is full. */
+	bool push(const TxEntry &entry);
+
+	/* Get the earliest scheduled time. Returns false if the queue is empty. */
+	bool peek(suo::Timestamp &tx_time) const;
+
+	/* Take the earliest scheduled frame. Returns false if the queue is empty. */
+	bool pop(TxEntry &entry);
+
+	size_t size() const;
+
+private:
+	unsigned int depth;
+	mutable std::mutex lock;
+	std::multimap<suo::Timestamp, TxEntry> entries;
+};
+
+
+/*
+ * Gap model for pacing the uplink transmissions.
+ * Keeps track of the time the modulator is busy with the already given frames and
+ * allows a new burst to start only after it plus the configured inter-frame gap.
+ */
+class TxPacer
+{
+public:
+
+	/*
+	 * symbol_rate: Modulator symbol rate [symbols/s]. 0 disables the pacing.
+	 * gap: Minimum idle time between bursts [symbols]
+	 */
+	TxPacer(float symbol_rate, unsigned int gap);
+
+	/* Can a new burst be started at the given time? Never blocks. */
+	bool ready(suo::Timestamp now) const;
+
+	/* Account a frame given to the framer. */
+	void transmitted(suo::Timestamp now, unsigned int symbols);
+
+	/*
+	 * Would a frame started now be finished, including the gap, before the given time?
+	 * Always true when the pacing is disabled.
+	 */
+	bool fits(suo::Timestamp now, unsigned int symbols, suo::Timestamp before) const;
+
+	/* Time when the modulator has finished the frames given so far [ns] */
+	suo::Timestamp busyUntil() const { return busy_until; }
+
+private:
+	suo::Timestamp symbolsToTime(unsigned int symbols) const;
+
+	float symbol_rate;
+	unsigned int gap;
+	suo::Timestamp busy_until;
+};
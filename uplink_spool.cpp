@@ -0,0 +1,205 @@
+#include "uplink_spool.hpp"
+
+#include <suo.hpp>
+#include <csp/csp.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace suo;
+
+
+#define SPOOL_MAGIC    "CSPSPOOL"
+#define SPOOL_VERSION  2
+
+struct UplinkSpool::SpoolHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t frame_max;
+	uint32_t head;         // Running index of the oldest frame not yet taken
+	uint32_t tail;         // Running index of the next free slot
+};
+
+struct UplinkSpool::SpoolSlot {
+	uint32_t id;           // CSP header in host byte order
+	uint32_t seq;
+	uint16_t length;       // CSP payload length before encoding
+	uint16_t frame_len;    // Length of the encoded frame
+	uint8_t prio;          // CSP priority
+	uint8_t taken;         // Frame has been taken out of order. The slot is freed when the head passes it.
+	uint64_t deadline;     // Wall clock deadline [ms since the epoch]. 0 = no deadline
+	uint8_t frame[UPLINK_SPOOL_FRAME_MAX];
+};
+
+
+uint64_t tx_wall_clock_ms() {
+	return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+UplinkSpool::UplinkSpool() :
+	fd(-1),
+	map_size(0),
+	header(nullptr),
+	slots(nullptr)
+{
+	fill(pending, pending + TX_PRIORITIES, 0);
+}
+
+
+UplinkSpool::~UplinkSpool() {
+	if (header != nullptr) {
+		msync(header, map_size, MS_SYNC);
+		munmap(header, map_size);
+	}
+	if (fd >= 0)
+		close(fd);
+}
+
+
+void UplinkSpool::open(const string &path, unsigned int slot_count) {
+
+	if (slot_count == 0)
+		throw SuoError("UplinkSpool: Invalid slot count");
+
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		throw SuoError("UplinkSpool: Failed to open %s: %s", path.c_str(), strerror(errno));
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		throw SuoError("UplinkSpool: fstat failed: %s", strerror(errno));
+
+	map_size = sizeof(SpoolHeader) + slot_count * sizeof(SpoolSlot);
+	const bool existing = ((size_t)st.st_size == map_size);
+	if (ftruncate(fd, map_size) < 0)
+		throw SuoError("UplinkSpool: ftruncate failed: %s", strerror(errno));
+
+	void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		throw SuoError("UplinkSpool: mmap failed: %s", strerror(errno));
+
+	header = static_cast<SpoolHeader*>(map);
+	slots = reinterpret_cast<SpoolSlot*>(header + 1);
+
+	if (existing && memcmp(header->magic, SPOOL_MAGIC, sizeof(header->magic)) == 0 &&
+	    header->version == SPOOL_VERSION && header->slot_count == slot_count &&
+	    header->frame_max == UPLINK_SPOOL_FRAME_MAX && header->tail - header->head <= slot_count) {
+		for (uint32_t i = header->head; i != header->tail; i++) {
+			const SpoolSlot &slot = slots[i % slot_count];
+			if (slot.taken == 0)
+				pending[slot.prio % TX_PRIORITIES]++;
+		}
+		csp_log_info("Uplink spool %s: %u frames recovered\n", path.c_str(), (unsigned int)size());
+		return;
+	}
+
+	// New or incompatible file
+	memset(header, 0, sizeof(SpoolHeader));
+	memcpy(header->magic, SPOOL_MAGIC, sizeof(header->magic));
+	header->version = SPOOL_VERSION;
+	header->slot_count = slot_count;
+	header->frame_max = UPLINK_SPOOL_FRAME_MAX;
+	msync(header, sizeof(SpoolHeader), MS_SYNC);
+}
+
+
+bool UplinkSpool::push(const TxEntry &entry, const uint8_t *frame, size_t len) {
+	if (header == nullptr || len > UPLINK_SPOOL_FRAME_MAX)
+		return false;
+
+	lock_guard<mutex> guard(lock);
+	if (header->tail - header->head >= header->slot_count)
+		return false;
+
+	SpoolSlot &slot = slots[header->tail % header->slot_count];
+	slot.id = entry.id.ext;
+	slot.seq = entry.seq;
+	slot.length = entry.length;
+	slot.frame_len = len;
+	slot.prio = entry.id.pri;
+	slot.taken = 0;
+	slot.deadline = 0;
+	if (entry.deadline != 0)
+		slot.deadline = tx_wall_clock_ms() + ((int64_t)entry.deadline - (int64_t)tx_clock_ms());
+	memcpy(slot.frame, frame, len);
+	pending[slot.prio]++;
+
+	// Shared mapping survives a crash of the modem. Schedule write back for power losses.
+	header->tail++;
+	msync(header, map_size, MS_ASYNC);
+	return true;
+}
+
+
+bool UplinkSpool::pop(unsigned int prio, TxEntry &entry, uint8_t *frame, size_t &len) {
+	if (header == nullptr || prio >= TX_PRIORITIES)
+		return false;
+
+	lock_guard<mutex> guard(lock);
+	if (pending[prio] == 0)
+		return false;
+
+	for (uint32_t i = header->head; i != header->tail; i++) {
+		SpoolSlot &slot = slots[i % header->slot_count];
+		if (slot.taken || slot.prio != prio)
+			continue;
+
+		entry.packet = NULL;
+		entry.id.ext = slot.id;
+		entry.seq = slot.seq;
+		entry.length = slot.length;
+		entry.tx_time = 0;
+		entry.deadline = 0;
+		if (slot.deadline != 0) {
+			// Back to the monotonic clock. An expired deadline stays in the past.
+			const int64_t remaining = (int64_t)slot.deadline - (int64_t)tx_wall_clock_ms();
+			entry.deadline = max<int64_t>(1, (int64_t)tx_clock_ms() + remaining);
+		}
+		len = slot.frame_len;
+		memcpy(frame, slot.frame, len);
+
+		slot.taken = 1;
+		pending[prio]--;
+
+		// Free the slots at the head which have been taken
+		while (header->head != header->tail && slots[header->head % header->slot_count].taken)
+			header->head++;
+		msync(header, map_size, MS_ASYNC);
+		return true;
+	}
+	return false;
+}
+
+
+size_t UplinkSpool::size() const {
+	if (header == nullptr)
+		return 0;
+	lock_guard<mutex> guard(lock);
+	size_t total = 0;
+	for (unsigned int prio = 0; prio < TX_PRIORITIES; prio++)
+		total += pending[prio];
+	return total;
+}
+
+
+size_t UplinkSpool::size(unsigned int prio) const {
+	if (header == nullptr || prio >= TX_PRIORITIES)
+		return 0;
+	lock_guard<mutex> guard(lock);
+	return pending[prio];
+}
+
+
+size_t UplinkSpool::capacity() const {
+	return (header != nullptr) ? header->slot_count : 0;
+}
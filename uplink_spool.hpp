@@ -0,0 +1,72 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+#include "tx_scheduler.hpp"
+
+/* Maximum length of an encoded frame stored in the spool [bytes] */
+#define UPLINK_SPOOL_FRAME_MAX  512
+
+/* Milliseconds since the Unix epoch. Unlike tx_clock_ms, comparable over a restart. */
+uint64_t tx_wall_clock_ms();
+
+/*
+ * Persistent per priority FIFO of encoded uplink frames.
+ *
+ * The frames are stored in fixed size slots of a memory mapped file, so frames
+ * waiting for the next pass survive a restart of the modem. The file begins with
+ * a header holding the ring buffer positions. A file with different geometry is
+ * reinitialized. Every slot keeps the frame's priority and its deadline in wall
+ * clock time, so the TTL also holds over a restart.
+ *
+ * Frames of one priority can be taken while older frames of other priorities stay
+ * in the spool. Their slots are reused once all the older frames have been taken.
+ */
+class UplinkSpool
+{
+public:
+	UplinkSpool();
+	~UplinkSpool();
+
+	UplinkSpool(const UplinkSpool &) = delete;
+	UplinkSpool &operator=(const UplinkSpool &) = delete;
+
+	/* Open or create the spool file. Throws SuoError on failure. */
+	void open(const std::string &path, unsigned int slots);
+
+	bool isOpen() const { return header != nullptr; }
+
+	/*
+	 * Store an encoded frame. The entry's deadline is in tx_clock_ms time (0 = no deadline).
+	 * Returns false if the spool is full or the frame is too long.
+	 */
+	bool push(const TxEntry &entry, const uint8_t *frame, size_t len);
+
+	/*
+	 * Take the oldest frame of the given priority. `frame` must have room for UPLINK_SPOOL_FRAME_MAX
+	 * bytes. The entry's packet pointer is NULL and its deadline is converted back to tx_clock_ms time.
+	 * Returns false if there are no frames of the priority.
+	 */
+	bool pop(unsigned int prio, TxEntry &entry, uint8_t *frame, size_t &len);
+
+	/* Number of frames waiting */
+	size_t size() const;
+
+	/* Number of frames of the given priority waiting */
+	size_t size(unsigned int prio) const;
+
+	size_t capacity() const;
+
+private:
+	struct SpoolHeader;
+	struct SpoolSlot;
+
+	mutable std::mutex lock;
+	int fd;
+	size_t map_size;
+	SpoolHeader *header;
+	SpoolSlot *slots;
+	unsigned int pending[TX_PRIORITIES];  // Number of frames waiting in each priority
+};